@@ -0,0 +1,103 @@
+#include "arena.hpp"
+
+// system includes
+#include <new>
+
+const std::size_t Arena::MAX_SMALL;
+const std::size_t Arena::BLOCK_SIZE;
+const std::size_t Arena::ALIGNMENT;
+
+Arena::Arena() noexcept: used(0), next(nullptr), end(nullptr), count(0){
+
+    for(auto & head : freeLists){
+        head = nullptr;
+    }
+}
+
+Arena::~Arena(){
+
+    for(char * block : blocks){
+        ::operator delete(block);
+    }
+}
+
+void * Arena::allocate(std::size_t bytes){
+
+    if(bytes > MAX_SMALL){
+        return ::operator new(bytes);
+    }
+
+    std::size_t units = (bytes == 0) ? 1 : (bytes + ALIGNMENT - 1) / ALIGNMENT;
+
+    // reuse a released object of the same size
+    void * p = freeLists[units];
+    if(p != nullptr){
+        freeLists[units] = *static_cast<void **>(p);
+        ++count;
+        return p;
+    }
+
+    std::size_t size = units * ALIGNMENT;
+
+    // the remainder of a full block is abandoned until the next reset
+    if(static_cast<std::size_t>(end - next) < size){
+        if(used == blocks.size()){
+            blocks.push_back(nullptr);
+            blocks.back() = static_cast<char *>(::operator new(BLOCK_SIZE));
+        }
+        next = blocks[used++];
+        end = next + BLOCK_SIZE;
+    }
+
+    p = next;
+    next += size;
+    ++count;
+    return p;
+}
+
+void Arena::deallocate(void * p, std::size_t bytes) noexcept{
+
+    if(bytes > MAX_SMALL){
+        ::operator delete(p);
+        return;
+    }
+
+    std::size_t units = (bytes == 0) ? 1 : (bytes + ALIGNMENT - 1) / ALIGNMENT;
+
+    *static_cast<void **>(p) = freeLists[units];
+    freeLists[units] = p;
+    --count;
+}
+
+bool Arena::owns(const void * p) const noexcept{
+
+    const char * c = static_cast<const char *>(p);
+    for(const char * block : blocks){
+        if(c >= block && c < block + BLOCK_SIZE){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::size_t Arena::live() const noexcept{
+
+    return count;
+}
+
+void Arena::reset() noexcept{
+
+    // memory of a live object must not be handed out again
+    if(count != 0){
+        return;
+    }
+
+    for(auto & head : freeLists){
+        head = nullptr;
+    }
+
+    used = 0;
+    next = nullptr;
+    end = nullptr;
+}
@@ -0,0 +1,133 @@
+/*! \file arena.hpp
+ Defines the arena the short-lived objects of an evaluation are allocated from.
+
+ Evaluating a program creates and destroys many small objects, e.g. the frame
+ of every lambda call made by the tree walker. Taking these from an arena
+ rather than the global heap avoids most of the cost of allocating them.
+ */
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+// system includes
+#include <cstddef>
+#include <vector>
+
+/*! \class Arena
+ \brief A region of memory for the temporaries of one evaluation.
+
+ Memory is carved out of large blocks by bumping a pointer. A freed object is
+ kept on a free list for its size and handed out again by the next request of
+ that size, so a loop creating one temporary per iteration runs in constant
+ memory. Requests larger than MAX_SMALL bytes are passed to the global heap.
+
+ reset releases all memory at once, keeping the blocks for the next
+ evaluation. Objects allocated from an arena must therefore not outlive the
+ evaluation; one that escapes, e.g. into the Environment, has to be copied to
+ ordinary storage first (see owns).
+ */
+class Arena {
+public:
+
+    /// the largest request served from the blocks of the arena
+    static const std::size_t MAX_SMALL = 256;
+
+    /// construct an empty arena, blocks are allocated on first use
+    Arena() noexcept;
+
+    /// release the blocks of the arena
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+
+    /*! Allocate memory, suitably aligned for any type.
+     \param bytes the size of the request
+     \return a pointer to the memory
+     \throws std::bad_alloc if no memory is available
+     */
+    void * allocate(std::size_t bytes);
+
+    /*! Release memory previously returned by allocate.
+     \param p the memory to release
+     \param bytes the size it was allocated with
+     */
+    void deallocate(void * p, std::size_t bytes) noexcept;
+
+    /// return true if p points into the blocks of the arena
+    bool owns(const void * p) const noexcept;
+
+    /// return the number of objects allocated and not yet released
+    std::size_t live() const noexcept;
+
+    /// release all memory for reuse. Has no effect while objects are live.
+    void reset() noexcept;
+
+private:
+
+    // size of each block
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+
+    // requests are rounded up to a multiple of this
+    static const std::size_t ALIGNMENT = alignof(std::max_align_t);
+
+    // the blocks, of which the first used are in use
+    std::vector<char *> blocks;
+    std::size_t used;
+
+    // the unallocated part of the last block in use
+    char * next;
+    char * end;
+
+    // heads of the free lists, indexed by size in units of ALIGNMENT. A free
+    // object holds the pointer to the next one.
+    void * freeLists[MAX_SMALL / ALIGNMENT + 1];
+
+    // number of objects allocated and not yet released
+    std::size_t count;
+};
+
+/*! \class ArenaAllocator
+ \brief A standard allocator taking its memory from an Arena.
+
+ Use with std::allocate_shared or the standard containers.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+
+    typedef T value_type;
+
+    /// construct an allocator for arena a
+    explicit ArenaAllocator(Arena & a) noexcept: arena(&a){}
+
+    /// construct an allocator sharing the arena of other
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> & other) noexcept: arena(other.arena){}
+
+    /// allocate memory for n objects of type T
+    T * allocate(std::size_t n){
+        return static_cast<T *>(arena->allocate(n * sizeof(T)));
+    }
+
+    /// release memory for n objects of type T
+    void deallocate(T * p, std::size_t n) noexcept{
+        arena->deallocate(p, n * sizeof(T));
+    }
+
+    /// the arena memory is taken from
+    Arena * arena;
+};
+
+/// allocators are equal if they share an arena
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> & left, const ArenaAllocator<U> & right) noexcept{
+    return left.arena == right.arena;
+}
+
+/// allocators are unequal if they do not share an arena
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> & left, const ArenaAllocator<U> & right) noexcept{
+    return left.arena != right.arena;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "catch.hpp"
+
+#include <cstdint>
+#include <memory>
+
+#include "arena.hpp"
+
+TEST_CASE( "Test arena allocation", "[arena]" ) {
+
+    Arena arena;
+
+    void * a = arena.allocate(24);
+    void * b = arena.allocate(24);
+
+    REQUIRE(a != b);
+    REQUIRE(arena.owns(a));
+    REQUIRE(arena.owns(b));
+    REQUIRE(arena.live() == 2);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(a) % alignof(std::max_align_t) == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(b) % alignof(std::max_align_t) == 0);
+
+    int local;
+    REQUIRE(!arena.owns(&local));
+
+    arena.deallocate(b, 24);
+    arena.deallocate(a, 24);
+    REQUIRE(arena.live() == 0);
+}
+
+TEST_CASE( "Test arena reuses released memory", "[arena]" ) {
+
+    Arena arena;
+
+    void * a = arena.allocate(40);
+    arena.deallocate(a, 40);
+
+    // a request of the same size takes the released memory
+    void * b = arena.allocate(40);
+    REQUIRE(b == a);
+
+    // a loop creating one temporary per iteration needs no new memory
+    for(int i = 0; i < 100000; ++i){
+        arena.deallocate(b, 40);
+        b = arena.allocate(40);
+        REQUIRE(b == a);
+    }
+
+    arena.deallocate(b, 40);
+}
+
+TEST_CASE( "Test arena reset", "[arena]" ) {
+
+    Arena arena;
+
+    void * first = arena.allocate(16);
+    void * second = arena.allocate(16);
+
+    // memory of live objects is not released
+    arena.reset();
+    void * third = arena.allocate(16);
+    REQUIRE(third != first);
+    REQUIRE(third != second);
+
+    arena.deallocate(first, 16);
+    arena.deallocate(second, 16);
+    arena.deallocate(third, 16);
+
+    arena.reset();
+    REQUIRE(arena.allocate(16) == first);
+    REQUIRE(arena.allocate(16) == second);
+}
+
+TEST_CASE( "Test arena passes large requests to the heap", "[arena]" ) {
+
+    Arena arena;
+
+    void * p = arena.allocate(Arena::MAX_SMALL + 1);
+    REQUIRE(!arena.owns(p));
+    REQUIRE(arena.live() == 0);
+    arena.deallocate(p, Arena::MAX_SMALL + 1);
+}
+
+TEST_CASE( "Test arena allocator", "[arena]" ) {
+
+    Arena arena;
+
+    {
+        std::shared_ptr<int> p = std::allocate_shared<int>(ArenaAllocator<int>(arena), 42);
+
+        REQUIRE(*p == 42);
+        REQUIRE(arena.owns(p.get()));
+        REQUIRE(arena.live() == 1);
+    }
+
+    REQUIRE(arena.live() == 0);
+
+    ArenaAllocator<int> a(arena);
+    ArenaAllocator<double> b(a);
+    REQUIRE(a == b);
+
+    Arena other;
+    REQUIRE(a != ArenaAllocator<int>(other));
+}
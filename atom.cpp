@@ -1,19 +1,51 @@
 #include "atom.hpp"
 
-#include <sstream>
+#include <atomic>
+#include <functional>
 #include <cctype>
 #include <cmath>
 #include <limits>
+#include <utility>
 
-Atom::Atom(): m_type(NoneKind) {}
+// a complex value shared between copies of an Atom
+struct Atom::ComplexBox {
+    std::atomic<std::size_t> refs;
+    const std::complex<double> value;
+    
+    ComplexBox(std::complex<double> v): refs(1), value(v){}
+};
+
+// a user string shared between copies of an Atom
+struct Atom::StringBox {
+    std::atomic<std::size_t> refs;
+    const std::string value;
+    
+    StringBox(const std::string & v): refs(1), value(v){}
+};
+
+// release a reference to a box, deleting it with the last one
+template <typename Box>
+void release(Box * box) noexcept{
+    if(box->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        delete box;
+    }
+}
+
+// add a reference to a box
+template <typename Box>
+void retain(Box * box) noexcept{
+    box->refs.fetch_add(1, std::memory_order_relaxed);
+}
 
-Atom::Atom(double value){
+Atom::Atom(): m_type(NoneKind), m_value() {}
+
+Atom::Atom(double value): Atom(){
     
     setNumber(value);
     
 }
 
-Atom::Atom(std::complex<double> value){
+Atom::Atom(std::complex<double> value): Atom(){
     
     setComplex(value);
     
@@ -21,22 +53,16 @@ Atom::Atom(std::complex<double> value){
 
 Atom::Atom(const Token & token): Atom(){
     
-    // is token a number?
-    double temp;
-    std::istringstream iss(token.asString());
-    if(iss >> temp){
-        // check for trailing characters if >> succeeds
-        if(iss.rdbuf()->in_avail() == 0){
-            setNumber(temp);
-        }
+    // the tokenizer has decided if the token is a number
+    if(token.isNumber()){
+        setNumber(token.asNumber());
     }
-    else{ // else assume symbol
+    else if(token.type() == Token::USERSTRING){
+        setUserString(token.asString());
+    }
+    else if(token.size() > 0 && !std::isdigit(static_cast<unsigned char>(token.data()[0]))){
         // make sure does not start with number
-        if(token.type() == Token::USERSTRING){
-            setUserString(token.asString());
-        } else if(!std::isdigit(token.asString()[0])){
-            setSymbol(token.asString());
-        }
+        setSymbol(token.asString());
     }
 }
 
@@ -46,41 +72,50 @@ Atom::Atom(const std::string & value): Atom() {
 }
 
 Atom::Atom(const Atom & x): Atom(){
-    if(x.isNumber()){
-        setNumber(x.complexValue.real());
-    }
-    else if(x.isSymbol()){
-        setSymbol(x.stringValue);
-    }
+    
+    *this = x;
+}
+
+Atom::Atom(Atom && x) noexcept: Atom(){
+    
+    *this = std::move(x);
 }
 
 Atom & Atom::operator=(const Atom & x){
     
     if(this != &x){
-        if(x.m_type == NoneKind){
-            m_type = NoneKind;
-        }
-        else if(x.m_type == NumberKind){
-            setNumber(x.complexValue.real());
-        }
-        else if(x.m_type == ComplexKind){
-            setComplex(x.complexValue);
+        // sharing the box before releasing the current one keeps this safe
+        // when both refer to the same box
+        if(x.m_type == ComplexKind){
+            retain(x.m_value.complex);
         }
-        else if(x.m_type == SymbolKind || x.m_type == ListKind || x.m_type == LambdaKind){
-            setSymbol(x.stringValue);
-        } else if(x.m_type == UserStringKind){
-            setUserString(x.stringValue);
+        else if(x.m_type == UserStringKind){
+            retain(x.m_value.string);
         }
+        
+        clear();
+        m_type = x.m_type;
+        m_value = x.m_value;
     }
     return *this;
 }
 
-Atom::~Atom(){
+Atom & Atom::operator=(Atom && x) noexcept{
     
-    // we need to ensure the destructor of the symbol string is called
-    if(m_type == SymbolKind){
-        stringValue.~basic_string();
+    if(this != &x){
+        // take over the box, if any, leaving x None
+        clear();
+        m_type = x.m_type;
+        m_value = x.m_value;
+        x.m_type = NoneKind;
     }
+    return *this;
+}
+
+Atom::~Atom(){
+    
+    // we need to ensure the box is released
+    clear();
 }
 
 bool Atom::isNone() const noexcept{
@@ -111,71 +146,101 @@ bool Atom::isLambda() const noexcept{
     return m_type == LambdaKind;
 }
 
+void Atom::clear() noexcept{
+    
+    if(m_type == ComplexKind){
+        release(m_value.complex);
+    }
+    else if(m_type == UserStringKind){
+        release(m_value.string);
+    }
+    
+    m_type = NoneKind;
+}
+
 void Atom::setNumber(double value){
     
+    clear();
+    
     m_type = NumberKind;
     
-    complexValue = std::complex<double>(value, 0.0);
+    m_value.number = value;
 }
 
 void Atom::setComplex(std::complex<double> value){
     
+    ComplexBox * box = new ComplexBox(value);
+    
+    clear();
+    
     m_type = ComplexKind;
     
-    complexValue = value;
+    m_value.complex = box;
 }
 
 void Atom::setSymbol(const std::string & value){
     
-    // we need to ensure the destructor of the symbol string is called
-    if(m_type == SymbolKind || m_type == ListKind || m_type == LambdaKind){
-        stringValue.~basic_string();
-    }
+    setSymbol(SymbolTable::instance().intern(value));
+}
+
+void Atom::setSymbol(SymbolId value){
     
-    if(value == "list"){
+    clear();
+    
+    if(value == SymbolTable::LIST){
         m_type = ListKind;
-    } else if (value == "lambda"){
+    } else if (value == SymbolTable::LAMBDA){
         m_type = LambdaKind;
     } else {
         m_type = SymbolKind;
     }
     
-    // copy construct in place
-    new (&stringValue) std::string(value);
+    m_value.symbol = value;
 }
 
 void Atom::setUserString(const std::string & value){
     
-    // we need to ensure the destructor of the symbol string is called
-    if(m_type == UserStringKind){
-        stringValue.~basic_string();
-    }
+    // value may be the string of this atom's own box, so box it first
+    StringBox * box = new StringBox(value);
+    
+    clear();
     
     m_type = UserStringKind;
     
-    // copy construct in place
-    new (&stringValue) std::string(value);
+    m_value.string = box;
 }
 
 double Atom::asNumber() const noexcept{
     
-    return (m_type == NumberKind) ? complexValue.real() : 0.0;
+    return (m_type == NumberKind) ? m_value.number : 0.0;
 }
 
 std::complex<double> Atom::asComplex() const noexcept{
     
-    return (m_type == ComplexKind) ? complexValue : std::complex<double> (0.0, 0.0);
+    return (m_type == ComplexKind) ? m_value.complex->value : std::complex<double> (0.0, 0.0);
 }
 
-std::string Atom::asSymbol() const noexcept{
+const std::string & Atom::asSymbol() const noexcept{
+    
+    static const std::string empty;
+    
+    if(m_type == SymbolKind || m_type == ListKind || m_type == LambdaKind){
+        return SymbolTable::instance().name(m_value.symbol);
+    }
+    else if(m_type == UserStringKind){
+        return m_value.string->value;
+    }
     
-    std::string result;
+    return empty;
+}
+
+SymbolId Atom::asSymbolId() const noexcept{
     
-    if(m_type == SymbolKind || m_type == ListKind || m_type == LambdaKind || m_type == UserStringKind){
-        result = stringValue;
+    if(m_type == SymbolKind || m_type == ListKind || m_type == LambdaKind){
+        return m_value.symbol;
     }
     
-    return result;
+    return std::numeric_limits<SymbolId>::max();
 }
 
 bool Atom::operator==(const Atom & right) const noexcept{
@@ -189,8 +254,8 @@ bool Atom::operator==(const Atom & right) const noexcept{
         case NumberKind:
         {
             if(right.m_type != NumberKind) return false;
-            double dleft = complexValue.real();
-            double dright = right.complexValue.real();
+            double dleft = m_value.number;
+            double dright = right.m_value.number;
             double diff = fabs(dleft - dright);
             if(std::isnan(diff) ||
                (diff > std::numeric_limits<double>::epsilon())) return false;
@@ -200,14 +265,14 @@ bool Atom::operator==(const Atom & right) const noexcept{
         {
             if(right.m_type != SymbolKind) return false;
             
-            return stringValue == right.stringValue;
+            return m_value.symbol == right.m_value.symbol;
         }
             break;
         case UserStringKind:
         {
             if(right.m_type != UserStringKind) return false;
             
-            return stringValue == right.stringValue;
+            return m_value.string == right.m_value.string || m_value.string->value == right.m_value.string->value;
         }
             break;
         default:
@@ -217,6 +282,57 @@ bool Atom::operator==(const Atom & right) const noexcept{
     return true;
 }
 
+bool Atom::identical(const Atom & right) const noexcept{
+    
+    if(m_type != right.m_type) return false;
+    
+    switch(m_type){
+        case NumberKind:
+            return m_value.number == right.m_value.number;
+        case ComplexKind:
+            return m_value.complex == right.m_value.complex || m_value.complex->value == right.m_value.complex->value;
+        case SymbolKind:
+        case ListKind:
+        case LambdaKind:
+            return m_value.symbol == right.m_value.symbol;
+        case UserStringKind:
+            return m_value.string == right.m_value.string || m_value.string->value == right.m_value.string->value;
+        default:
+            return true;
+    }
+}
+
+// the hash of a number, equal for 0 and -0 as they are identical
+std::size_t hash_number(double value) noexcept{
+    return std::hash<double>()(value == 0 ? 0.0 : value);
+}
+
+std::size_t Atom::hash() const noexcept{
+    
+    std::size_t h = static_cast<std::size_t>(m_type);
+    
+    switch(m_type){
+        case NumberKind:
+            h ^= hash_number(m_value.number);
+            break;
+        case ComplexKind:
+            h ^= hash_number(m_value.complex->value.real()) * 31 + hash_number(m_value.complex->value.imag());
+            break;
+        case SymbolKind:
+        case ListKind:
+        case LambdaKind:
+            h ^= std::hash<SymbolId>()(m_value.symbol) << 3;
+            break;
+        case UserStringKind:
+            h ^= std::hash<std::string>()(m_value.string->value);
+            break;
+        default:
+            break;
+    }
+    
+    return h;
+}
+
 bool operator!=(const Atom & left, const Atom & right) noexcept{
     
     return !(left == right);
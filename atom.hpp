@@ -4,6 +4,7 @@
 #ifndef ATOM_HPP
 #define ATOM_HPP
 
+#include "symbol.hpp"
 #include "token.hpp"
 
 #include <complex>
@@ -13,7 +14,10 @@
 /*! \class Atom
  \brief A variant type that may be a Number or Symbol or the default type None.
  
- This class provides value semantics.
+ This class provides value semantics. An Atom is a 16 byte tagged value:
+ numbers and interned symbols are stored inline, while complex numbers and
+ user strings are boxed out-of-line. Boxes are immutable and shared between
+ copies of an Atom, so copying never allocates.
  */
 class Atom {
 public:
@@ -36,9 +40,15 @@ public:
     /// Copy-construct an Atom
     Atom(const Atom & x);
     
+    /// Move-construct an Atom, leaving x a valid Atom of unspecified value
+    Atom(Atom && x) noexcept;
+    
     /// Assign an Atom
     Atom & operator=(const Atom & x);
     
+    /// Move-assign an Atom, leaving x a valid Atom of unspecified value
+    Atom & operator=(Atom && x) noexcept;
+    
     /// Atom destructor
     ~Atom();
     
@@ -70,11 +80,20 @@ public:
     std::complex<double> asComplex() const noexcept;
     
     /// value of Atom as a number, returns empty-string if not a Symbol
-    std::string asSymbol() const noexcept;
+    const std::string & asSymbol() const noexcept;
+    
+    /// interned id of a Symbol Atom (see SymbolTable), returns the maximum SymbolId if not a Symbol
+    SymbolId asSymbolId() const noexcept;
     
     /// equality comparison based on type and value
     bool operator==(const Atom & right) const noexcept;
     
+    /// exact comparison of type and value, numbers compared without tolerance
+    bool identical(const Atom & right) const noexcept;
+    
+    /// hash of type and value, equal for identical atoms
+    std::size_t hash() const noexcept;
+    
 private:
     
     // internal enum of known types
@@ -83,12 +102,23 @@ private:
     // track the type
     Type m_type;
     
-    // values for the known types. Note the use of a union requires care
-    // when setting non POD values (see setSymbol)
-    union {
-        std::complex<double> complexValue;
-        std::string stringValue;
+    // boxed values, defined in atom.cpp
+    struct ComplexBox;
+    struct StringBox;
+    
+    // values for the known types. Symbol, List and Lambda atoms store the
+    // interned id of their name, Complex and UserString atoms a reference
+    // counted box.
+    union Value {
+        double number;
+        SymbolId symbol;
+        ComplexBox * complex;
+        StringBox * string;
     };
+    Value m_value;
+    
+    // helper to release the box of the current value, if any
+    void clear() noexcept;
     
     // helper to set type and value of Number
     void setNumber(double value);
@@ -99,8 +129,14 @@ private:
     // helper to set type and value of Symbol
     void setSymbol(const std::string & value);
     
+    // helper to set type and value of Symbol from an interned id
+    void setSymbol(SymbolId value);
+    
     // helper to set type and value of user string
     void setUserString(const std::string & value);
+    
+    // restores user strings exactly, whatever their text
+    friend class Image;
 };
 
 /// inequality comparison for Atom
@@ -1,5 +1,7 @@
 #include "catch.hpp"
 
+#include <type_traits>
+
 #include "atom.hpp"
 
 TEST_CASE( "Test constructors", "[atom]" ) {
@@ -65,6 +67,16 @@ TEST_CASE( "Test constructors", "[atom]" ) {
         REQUIRE(!a.isNone());
         REQUIRE(d.isNumber());
         REQUIRE(!d.isSymbol());
+        
+        Atom e(std::complex<double>(1.0, 2.0));
+        Atom f = e;
+        REQUIRE(f.isComplex());
+        REQUIRE(f.asComplex() == e.asComplex());
+        
+        Atom g(Token(Token::USERSTRING, "\"hi\""));
+        Atom h = g;
+        REQUIRE(h.isUserString());
+        REQUIRE(h.asSymbol() == "\"hi\"");
     }
 }
 
@@ -155,6 +167,84 @@ TEST_CASE( "Test assignment", "[atom]" ) {
     }
 }
 
+TEST_CASE( "Test move", "[atom]" ) {
+    
+    REQUIRE(std::is_nothrow_move_constructible<Atom>::value);
+    REQUIRE(std::is_nothrow_move_assignable<Atom>::value);
+    
+    {
+        INFO("move construct");
+        Atom a(Token(Token::USERSTRING, "\"hi\""));
+        Atom b(std::move(a));
+        REQUIRE(b.isUserString());
+        REQUIRE(b.asSymbol() == "\"hi\"");
+        
+        Atom c(1.0);
+        Atom d(std::move(c));
+        REQUIRE(d.isNumber());
+        REQUIRE(d.asNumber() == 1.0);
+    }
+    
+    {
+        INFO("user string to number");
+        Atom a(Token(Token::USERSTRING, "\"hi\""));
+        Atom b(1.0);
+        b = std::move(a);
+        REQUIRE(b.isUserString());
+        REQUIRE(b.asSymbol() == "\"hi\"");
+    }
+    
+    {
+        INFO("user string to user string");
+        Atom a(Token(Token::USERSTRING, "\"hi\""));
+        Atom b(Token(Token::USERSTRING, "\"bye\""));
+        b = std::move(a);
+        REQUIRE(b.isUserString());
+        REQUIRE(b.asSymbol() == "\"hi\"");
+    }
+    
+    {
+        INFO("symbol to user string");
+        Atom a("hi");
+        Atom b(Token(Token::USERSTRING, "\"bye\""));
+        b = std::move(a);
+        REQUIRE(b.isSymbol());
+        REQUIRE(b.asSymbol() == "hi");
+    }
+}
+
+TEST_CASE( "Test compact layout", "[atom]" ) {
+    
+    // a type tag and an inline number, symbol id or pointer to a box
+    REQUIRE(sizeof(Atom) <= 16);
+    
+    {
+        INFO("copies share a boxed complex");
+        Atom a(std::complex<double>(1.0, 2.0));
+        Atom b(a);
+        a = Atom(3.0);
+        REQUIRE(b.isComplex());
+        REQUIRE(b.asComplex() == std::complex<double>(1.0, 2.0));
+        REQUIRE(a.asComplex() == std::complex<double>(0.0, 0.0));
+    }
+    
+    {
+        INFO("copies share a boxed user string");
+        Atom a(Token(Token::USERSTRING, "\"hi\""));
+        Atom b(a);
+        Atom c(Token(Token::USERSTRING, "\"hi\""));
+        REQUIRE(&b.asSymbol() == &a.asSymbol());
+        REQUIRE(b == a);
+        REQUIRE(c == a);
+        
+        a = Atom(1.0);
+        REQUIRE(b.asSymbol() == "\"hi\"");
+        
+        b = b;
+        REQUIRE(b.asSymbol() == "\"hi\"");
+    }
+}
+
 TEST_CASE( "test comparison", "[atom]" ) {
     
     {
@@ -0,0 +1,512 @@
+#include "compiler.hpp"
+
+// system includes
+#include <algorithm>
+
+// module includes
+#include "semantic_error.hpp"
+
+// error messages, kept identical to the ones raised by Expression::eval
+const std::string ERR_TERMINAL = "Error during evaluation: Invalid type in terminal expression";
+const std::string ERR_DEFINE_NARGS = "Error during evaluation: invalid number of arguments to define";
+const std::string ERR_DEFINE_SYMBOL = "Error during evaluation: first argument to define not symbol";
+const std::string ERR_DEFINE_SPECIAL = "Error during evaluation: attempt to redefine a special-form";
+const std::string ERR_LAMBDA_NARGS = "Error during evaluation: invalid number of arguments to lambda";
+const std::string ERR_APPLY_PROC = "Error: first argument to apply not a procedure";
+const std::string ERR_APPLY_LIST = "Error: second argument to apply not a list";
+const std::string ERR_APPLY_NARGS = "Error during evaluation: invalid number of arguments to apply";
+const std::string ERR_MAP_PROC = "Error: first argument to map not a procedure";
+const std::string ERR_MAP_LIST = "Error: second argument to map not a list";
+const std::string ERR_MAP_NARGS = "Error during evaluation: invalid number of arguments to map";
+const std::string ERR_PMAP_PROC = "Error: first argument to pmap not a procedure";
+const std::string ERR_PMAP_NARGS = "Error during evaluation: invalid number of arguments to pmap";
+const std::string ERR_PROC_NAME = "Error during evaluation: procedure name not symbol";
+const std::string ERR_IF_NARGS = "Error during evaluation: invalid number of arguments to if";
+
+/***********************************************************************
+ Helper Functions
+ **********************************************************************/
+
+// the lexical scope code is compiled in: the parameters of each enclosing
+// lambda, innermost first. Mirrors the chain of Frames at run time, in which
+// lambdas without parameters have no Frame.
+struct Scope {
+    const std::vector<Atom> * parameters;
+    const Scope * parent;
+};
+
+std::uint32_t add_constant(Chunk & chunk, const Expression & exp){
+    chunk.constants.push_back(exp);
+    return chunk.constants.size() - 1;
+}
+
+std::uint32_t add_symbol(Chunk & chunk, const Atom & sym){
+    for(std::size_t i = 0; i < chunk.symbols.size(); ++i){
+        if(chunk.symbols[i] == sym){
+            return i;
+        }
+    }
+    chunk.symbols.push_back(sym);
+    chunk.calls.emplace_back();
+    return chunk.symbols.size() - 1;
+}
+
+std::uint32_t add_message(Chunk & chunk, const std::string & message){
+    for(std::size_t i = 0; i < chunk.messages.size(); ++i){
+        if(chunk.messages[i] == message){
+            return i;
+        }
+    }
+    chunk.messages.push_back(message);
+    return chunk.messages.size() - 1;
+}
+
+void emit(Chunk & chunk, Instruction::OpCode op, std::uint32_t a = 0, std::uint32_t b = 0){
+    chunk.code.emplace_back(op, a, b);
+}
+
+void emit_throw(Chunk & chunk, const std::string & message){
+    emit(chunk, Instruction::THROW, add_message(chunk, message));
+}
+
+bool is_form(const Atom & head, SymbolId form){
+    return head.isSymbol() && head.asSymbolId() == form;
+}
+
+// return the i-th element of the tail of exp
+const Expression & tail_at(const Expression & exp, std::size_t i){
+    return *(exp.tailConstBegin() + i);
+}
+
+// predicate, sym is a parameter of a lambda enclosing the code
+bool is_parameter(const Atom & sym, const Scope * scope){
+
+    for(const Scope * s = scope; s != nullptr; s = s->parent){
+        if(std::find(s->parameters->begin(), s->parameters->end(), sym) != s->parameters->end()){
+            return true;
+        }
+    }
+    return false;
+}
+
+// predicate, op is a built-in computing numbers from numbers and nothing else
+bool is_foldable(const Atom & op){
+
+    static const std::vector<std::string> names = {"+", "-", "*", "/", "sqrt", "^", "ln", "<",
+        "sin", "cos", "tan", "real", "imag", "mag", "arg", "conj"};
+
+    return op.isSymbol() && std::find(names.begin(), names.end(), op.asSymbol()) != names.end();
+}
+
+// compute the value of exp at compile time if it is a number, a built-in
+// constant such as pi, or a call of a foldable built-in whose arguments can be
+// folded in turn. Returns false if it is not, or if the call raises an error,
+// which is left to be raised if and when the code runs.
+bool fold(const Expression & exp, const Scope * scope, const Environment * env, Expression & value){
+
+    const Atom & head = exp.head();
+
+    if(env == nullptr || !(head.isNumber() || head.isSymbol()) || is_parameter(head, scope)){
+        return false;
+    }
+
+    if(exp.tailSize() == 0){
+        if(head.isNumber()){
+            value = exp;
+            return true;
+        }
+        if(env->is_exp(head) && env->is_builtin(head)){
+            value = env->get_exp(head);
+            return true;
+        }
+        return false;
+    }
+
+    if(!is_foldable(head) || !env->is_builtin(head)){
+        return false;
+    }
+
+    std::vector<Expression> args;
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        args.emplace_back();
+        if(!fold(*it, scope, env, args.back())){
+            return false;
+        }
+    }
+
+    try{
+        value = env->get_proc(head)(args);
+    }
+    catch(const SemanticError &){
+        return false;
+    }
+    return true;
+}
+
+/***********************************************************************
+ Each of the functions below compiles one kind of node, mirroring the
+ corresponding handle_* member of Expression. The tail flag is set when
+ the value of the node is the value of the enclosing lambda.
+ **********************************************************************/
+
+void compile_expression(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail = false);
+std::shared_ptr<const Chunk> compile_lambda_in_scope(const Expression & lambda, const Scope * scope, const Environment * env);
+
+void compile_lookup(const Atom & head, Chunk & chunk, const Scope * scope){
+
+    if(head.isSymbol()){
+        // parameters of enclosing lambdas shadow global definitions. Depth 0
+        // is the current call, whose slots are on the stack, and each depth
+        // beyond it one frame of the closure. Lambdas without parameters
+        // have no frame, so their scopes are not counted.
+        std::uint32_t depth = 0;
+        for(const Scope * s = scope; s != nullptr; s = s->parent){
+            if(s != scope && !s->parameters->empty()){
+                ++depth;
+            }
+            for(std::size_t i = 0; i < s->parameters->size(); ++i){
+                if((*s->parameters)[i] == head){
+                    emit(chunk, Instruction::LOAD_SLOT, depth, i);
+                    return;
+                }
+            }
+        }
+        emit(chunk, Instruction::LOAD, add_symbol(chunk, head));
+    }
+    else if(head.isNumber()){
+        emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, Expression(head)));
+    }
+    else{
+        emit_throw(chunk, ERR_TERMINAL);
+    }
+}
+
+void compile_begin(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail){
+
+    // evaluate each arg from tail, keeping only the last
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        if(it != exp.tailConstBegin()){
+            emit(chunk, Instruction::POP);
+        }
+        compile_expression(*it, chunk, scope, env, tail && (it + 1 == exp.tailConstEnd()));
+    }
+}
+
+void compile_if(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail){
+
+    if(exp.tailSize() != 3){
+        emit_throw(chunk, ERR_IF_NARGS);
+        return;
+    }
+
+    compile_expression(tail_at(exp, 0), chunk, scope, env);
+    std::uint32_t branch = chunk.code.size();
+    emit(chunk, Instruction::JUMP_IF_FALSE);
+
+    compile_expression(tail_at(exp, 1), chunk, scope, env, tail);
+    std::uint32_t skip = chunk.code.size();
+    emit(chunk, Instruction::JUMP);
+
+    // patch both jumps now their targets are known
+    chunk.code[branch].a = chunk.code.size();
+    compile_expression(tail_at(exp, 2), chunk, scope, env, tail);
+    chunk.code[skip].a = chunk.code.size();
+}
+
+// build the lambda value the tree walker would produce for exp, returns
+// false (after emitting a THROW) if exp is malformed
+bool make_lambda(const Expression & exp, Expression & lambda, Chunk & chunk){
+
+    if(exp.tailSize() != 2){
+        emit_throw(chunk, ERR_LAMBDA_NARGS);
+        return false;
+    }
+
+    const Expression & params = tail_at(exp, 0);
+
+    Expression arguments(Atom("list"));
+    arguments.append(params.head());
+    for(auto it = params.tailConstBegin(); it != params.tailConstEnd(); ++it){
+        arguments.append(*it);
+    }
+
+    lambda = Expression(Atom("lambda"));
+    lambda.append(arguments);
+    lambda.append(tail_at(exp, 1));
+
+    emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, lambda));
+
+    return true;
+}
+
+void compile_define(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env){
+
+    if(exp.tailSize() != 2){
+        emit_throw(chunk, ERR_DEFINE_NARGS);
+        return;
+    }
+
+    const Expression & name = tail_at(exp, 0);
+    const Expression & value = tail_at(exp, 1);
+
+    if(!name.isHeadSymbol()){
+        emit_throw(chunk, ERR_DEFINE_SYMBOL);
+        return;
+    }
+
+    if(is_form(name.head(), SymbolTable::DEFINE) || is_form(name.head(), SymbolTable::BEGIN)){
+        emit_throw(chunk, ERR_DEFINE_SPECIAL);
+        return;
+    }
+
+    if(value.isHeadLambda()){
+        Expression lambda;
+        if(make_lambda(value, lambda, chunk)){
+            chunk.functions.push_back(compile_lambda_in_scope(lambda, scope, env));
+            emit(chunk, Instruction::DEFINE_PROC, add_symbol(chunk, name.head()), chunk.functions.size() - 1);
+        }
+    }
+    else{
+        compile_expression(value, chunk, scope, env);
+        emit(chunk, Instruction::DEFINE, add_symbol(chunk, name.head()));
+    }
+}
+
+void compile_list(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env){
+
+    // a list of numbers evaluates to itself, sharing its packed tail
+    if(exp.tailNumbers() != nullptr){
+        emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, exp));
+        return;
+    }
+
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        compile_expression(*it, chunk, scope, env);
+    }
+    emit(chunk, Instruction::MAKE_LIST, exp.tailSize());
+}
+
+// emit the check that the first argument of apply/map names a procedure,
+// returns false if it statically cannot
+bool compile_proc_check(const Expression & proc, const std::string & message, Chunk & chunk){
+
+    if(proc.tailSize() != 0 || !proc.isHeadSymbol()){
+        emit_throw(chunk, message);
+        return false;
+    }
+
+    emit(chunk, Instruction::CHECK_PROC, add_symbol(chunk, proc.head()), add_message(chunk, message));
+    return true;
+}
+
+void compile_apply(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail){
+
+    const Expression & proc = tail_at(exp, 0);
+
+    if(!compile_proc_check(proc, ERR_APPLY_PROC, chunk)){
+        return;
+    }
+
+    if(exp.tailSize() < 2 || !tail_at(exp, 1).isHeadList()){
+        emit_throw(chunk, ERR_APPLY_LIST);
+        return;
+    }
+
+    if(exp.tailSize() != 2){
+        emit_throw(chunk, ERR_APPLY_NARGS);
+        return;
+    }
+
+    const Expression & args = tail_at(exp, 1);
+    for(std::size_t i = 0; i < static_cast<std::size_t>(args.tailSize()); ++i){
+        compile_expression(args.tailAt(i), chunk, scope, env);
+    }
+    emit(chunk, tail ? Instruction::TAIL_CALL : Instruction::CALL, add_symbol(chunk, proc.head()), args.tailSize());
+}
+
+void compile_map(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env){
+
+    const Expression & proc = tail_at(exp, 0);
+
+    if(!compile_proc_check(proc, ERR_MAP_PROC, chunk)){
+        return;
+    }
+
+    bool secondArgRange = false;
+
+    if(exp.tailSize() < 2){
+        emit_throw(chunk, ERR_MAP_LIST);
+        return;
+    }
+
+    const Expression & args = tail_at(exp, 1);
+
+    if(!args.isHeadList()){
+        if(is_form(args.head(), SymbolTable::RANGE)){
+            secondArgRange = true;
+        }
+        else{
+            emit_throw(chunk, ERR_MAP_LIST);
+            return;
+        }
+    }
+
+    if(exp.tailSize() != 2){
+        emit_throw(chunk, ERR_MAP_NARGS);
+        return;
+    }
+
+    std::uint32_t sym = add_symbol(chunk, proc.head());
+
+    if(!secondArgRange){
+        // the list is literal, so the loop can be unrolled
+        for(std::size_t i = 0; i < static_cast<std::size_t>(args.tailSize()); ++i){
+            compile_expression(args.tailAt(i), chunk, scope, env);
+            emit(chunk, Instruction::CALL, sym, 1);
+        }
+        emit(chunk, Instruction::MAKE_LIST, args.tailSize());
+    }
+    else{
+        compile_expression(args, chunk, scope, env);
+
+        emit(chunk, Instruction::ITER_BEGIN);
+        std::uint32_t loop = chunk.code.size();
+        emit(chunk, Instruction::ITER_NEXT);
+        emit(chunk, Instruction::CALL, sym, 1);
+        emit(chunk, Instruction::ITER_COLLECT);
+        emit(chunk, Instruction::JUMP, loop);
+
+        // patch the loop exit now its target is known
+        chunk.code[loop].a = chunk.code.size();
+    }
+}
+
+void compile_pmap(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env){
+
+    const Expression & proc = tail_at(exp, 0);
+
+    if(!compile_proc_check(proc, ERR_PMAP_PROC, chunk)){
+        return;
+    }
+
+    if(exp.tailSize() != 2){
+        emit_throw(chunk, ERR_PMAP_NARGS);
+        return;
+    }
+
+    // unlike map, the list may be given by any expression; parallel_map checks
+    // its value is a list
+    compile_expression(tail_at(exp, 1), chunk, scope, env);
+    emit(chunk, Instruction::PARALLEL_MAP, add_symbol(chunk, proc.head()));
+}
+
+void compile_procedure(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail){
+
+    // continuous-plot takes its function argument unevaluated
+    bool unevaluated = is_form(exp.head(), SymbolTable::CONTINUOUS_PLOT);
+
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        if(unevaluated){
+            emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, *it));
+        }
+        else{
+            compile_expression(*it, chunk, scope, env);
+        }
+    }
+
+    if(!exp.isHeadSymbol()){
+        emit_throw(chunk, ERR_PROC_NAME);
+        return;
+    }
+
+    emit(chunk, tail ? Instruction::TAIL_CALL : Instruction::CALL, add_symbol(chunk, exp.head()), exp.tailSize());
+}
+
+void compile_expression(const Expression & exp, Chunk & chunk, const Scope * scope, const Environment * env, bool tail){
+
+    const Atom & head = exp.head();
+
+    Expression value;
+    if(fold(exp, scope, env, value)){
+        emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, value));
+    }
+    else if(exp.tailSize() == 0 && !head.isList() && !head.isLambda() && !head.isUserString()){
+        compile_lookup(head, chunk, scope);
+    }
+    else if(is_form(head, SymbolTable::BEGIN)){
+        compile_begin(exp, chunk, scope, env, tail);
+    }
+    else if(is_form(head, SymbolTable::IF)){
+        compile_if(exp, chunk, scope, env, tail);
+    }
+    else if(is_form(head, SymbolTable::DEFINE)){
+        compile_define(exp, chunk, scope, env);
+    }
+    else if(is_form(head, SymbolTable::APPLY)){
+        compile_apply(exp, chunk, scope, env, tail);
+    }
+    else if(is_form(head, SymbolTable::MAP)){
+        compile_map(exp, chunk, scope, env);
+    }
+    else if(is_form(head, SymbolTable::PMAP)){
+        compile_pmap(exp, chunk, scope, env);
+    }
+    else if(head.isLambda()){
+        Expression lambda;
+        make_lambda(exp, lambda, chunk);
+    }
+    else if(head.isList()){
+        compile_list(exp, chunk, scope, env);
+    }
+    else if(head.isUserString()){
+        emit(chunk, Instruction::PUSH_CONST, add_constant(chunk, exp));
+    }
+    else{
+        compile_procedure(exp, chunk, scope, env, tail);
+    }
+}
+
+std::shared_ptr<const Chunk> compile_lambda_in_scope(const Expression & lambda, const Scope * scope, const Environment * env){
+
+    std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+
+    const Expression & params = tail_at(lambda, 0);
+    for(auto it = params.tailConstBegin(); it != params.tailConstEnd(); ++it){
+        if(it->isHeadSymbol()){
+            chunk->parameters.push_back(it->head());
+        }
+    }
+
+    // the scope of the lambda is the current call even without parameters,
+    // which then has no frame for the lambdas it defines to capture
+    Scope inner{&chunk->parameters, scope};
+
+    compile_expression(tail_at(lambda, 1), *chunk, &inner, env, true);
+    emit(*chunk, Instruction::RETURN);
+
+    return chunk;
+}
+
+std::shared_ptr<const Chunk> compile(const Expression & ast, const Environment * env){
+
+    std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+
+    compile_expression(ast, *chunk, nullptr, env);
+    emit(*chunk, Instruction::RETURN);
+
+    return chunk;
+}
+
+std::shared_ptr<const Chunk> compile_lambda(const Expression & lambda, const Frame * closure, const Environment * env){
+
+    // rebuild the compile-time scope from the chain of run-time frames
+    std::vector<Scope> scopes;
+    for(const Frame * f = closure; f != nullptr; f = f->parent.get()){
+        scopes.push_back(Scope{f->names.get(), nullptr});
+    }
+    for(std::size_t i = 0; i + 1 < scopes.size(); ++i){
+        scopes[i].parent = &scopes[i + 1];
+    }
+
+    return compile_lambda_in_scope(lambda, scopes.empty() ? nullptr : &scopes[0], env);
+}
@@ -0,0 +1,131 @@
+/*! \file compiler.hpp
+ Defines the bytecode representation of a program and the compile function
+ that lowers a parsed Expression (AST) into it.
+
+ Compilation happens once after parsing. All decisions the tree walker makes
+ on every visit of a node (which special-form it is, whether an argument list
+ is well formed, ...) are made here instead, so the VirtualMachine (see vm.hpp)
+ only has to dispatch on a small integer opcode.
+ */
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+// system includes
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \class Instruction
+ \brief A single bytecode instruction: an opcode and two integer operands.
+
+ The meaning of the operands depends on the opcode, see OpCode.
+ */
+struct Instruction {
+
+    /*! \enum OpCode
+     \brief The instruction set of the stack virtual machine.
+     */
+    enum OpCode : std::uint8_t {
+        PUSH_CONST,   //< push constants[a]
+        LOAD,         //< push the value symbols[a] maps to in the environment
+        LOAD_SLOT,    //< push argument b of the current lambda call (a = 0) or of the a-th frame of its closure
+        POP,          //< discard the top of the stack
+        DEFINE,       //< bind symbols[a] to the top of the stack (kept on the stack)
+        DEFINE_PROC,  //< bind symbols[a] to the lambda on top of the stack with body functions[b]
+        MAKE_LIST,    //< replace the top a values with a list of them
+        CHECK_PROC,   //< throw messages[b] unless symbols[a] names a procedure
+        CALL,         //< call the procedure symbols[a] with the top b values as arguments
+        TAIL_CALL,    //< as CALL, but a lambda replaces the current frame instead of pushing one
+        ITER_BEGIN,   //< start iterating the list on top of the stack
+        ITER_NEXT,    //< push the next element of the iteration, or finish and jump to a
+        ITER_COLLECT, //< append the top of the stack to the iteration result
+        PARALLEL_MAP, //< replace the list on top of the stack with the results of calling symbols[a] on each element, in parallel
+        JUMP,         //< continue at instruction a
+        JUMP_IF_FALSE,//< pop the top of the stack, continue at instruction a if it is zero
+        THROW,        //< throw a SemanticError with messages[a]
+        RETURN        //< return the top of the stack to the caller
+    };
+
+    /// construct an instruction
+    Instruction(OpCode o, std::uint32_t x = 0, std::uint32_t y = 0): op(o), a(x), b(y) {}
+
+    OpCode op;
+    std::uint32_t a;
+    std::uint32_t b;
+};
+
+/*! \class Chunk
+ \brief A compiled unit of bytecode: either a whole program or a lambda body.
+
+ Operands of the instructions index into the tables of the same chunk. A chunk
+ is immutable once compiled and shared (via std::shared_ptr) between the
+ program that created it and any environment binding that refers to it.
+ */
+struct Chunk {
+
+    /// the instructions, executed from index 0 until RETURN
+    std::vector<Instruction> code;
+
+    /// literal values referenced by PUSH_CONST
+    std::vector<Expression> constants;
+
+    /// symbols referenced by LOAD, DEFINE, DEFINE_PROC, CHECK_PROC and CALL
+    std::vector<Atom> symbols;
+
+    /// the inline caches of the procedures the calls of symbols[i] resolve to,
+    /// filled when the chunk runs
+    mutable std::vector<CallCache> calls;
+
+    /// error messages referenced by THROW and CHECK_PROC
+    std::vector<std::string> messages;
+
+    /// compiled lambda bodies referenced by DEFINE_PROC
+    std::vector<std::shared_ptr<const Chunk>> functions;
+
+    /// parameter symbols, in order, when the chunk is a lambda body. References
+    /// to these in the body are compiled to LOAD_SLOT rather than LOAD.
+    std::vector<Atom> parameters;
+};
+
+/*! \fn compile
+ \brief lower an expression (abstract syntax tree) into bytecode
+
+ \param ast the expression to compile, typically the result of parse
+ \param env the environment the program will be evaluated in, if known
+ \return the compiled program
+
+ Calls in tail position of a lambda body (the body itself, the last expression
+ of a begin or either branch of an if there) are compiled to TAIL_CALL, so
+ tail recursion runs without growing the call-frame stack.
+
+ Compilation never fails: semantic errors that can be detected statically are
+ compiled into THROW instructions so they are raised when (and only if) the
+ program is run, in the same order the tree walker would raise them.
+
+ Given the environment, calls of arithmetic built-ins whose arguments are
+ numbers or built-in constants, e.g. (/ pi 2), are computed once here and
+ compiled to their value. Only symbols for which env.is_builtin holds are
+ folded, so the program must have been declared to env first (see
+ Environment::declare_definitions). Lambda values keep their original bodies.
+ */
+std::shared_ptr<const Chunk> compile(const Expression & ast, const Environment * env = nullptr);
+
+/*! \fn compile_lambda
+ \brief compile the body of a lambda value
+
+ \param lambda a lambda value, as produced by evaluating a lambda special-form
+ \param closure the frame the lambda was defined in, used to resolve references
+ to the parameters of enclosing lambdas
+ \param env the environment, to fold constants as compile does
+ \return the compiled body, with its parameters recorded in the chunk
+ */
+std::shared_ptr<const Chunk> compile_lambda(const Expression & lambda, const Frame * closure = nullptr,
+                                            const Environment * env = nullptr);
+
+#endif
@@ -0,0 +1,189 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <sstream>
+
+#include "compiler.hpp"
+#include "parse.hpp"
+
+std::shared_ptr<const Chunk> compileProgram(const std::string & program){
+
+    std::istringstream iss(program);
+
+    TokenSequenceType tokens = tokenize(iss);
+
+    return compile(parse(tokens));
+}
+
+TEST_CASE( "Test compiling a procedure call", "[compiler]" ) {
+
+    std::shared_ptr<const Chunk> chunk = compileProgram("(+ 1 2)");
+
+    REQUIRE(chunk->code.size() == 4);
+    REQUIRE(chunk->code[0].op == Instruction::PUSH_CONST);
+    REQUIRE(chunk->code[1].op == Instruction::PUSH_CONST);
+    REQUIRE(chunk->code[2].op == Instruction::CALL);
+    REQUIRE(chunk->code[2].b == 2);
+    REQUIRE(chunk->symbols[chunk->code[2].a] == Atom("+"));
+    REQUIRE(chunk->code[3].op == Instruction::RETURN);
+
+    REQUIRE(chunk->constants[chunk->code[0].a] == Expression(1.));
+    REQUIRE(chunk->constants[chunk->code[1].a] == Expression(2.));
+}
+
+TEST_CASE( "Test compiling special forms", "[compiler]" ) {
+
+    {
+        INFO("begin discards all but the last result");
+        std::shared_ptr<const Chunk> chunk = compileProgram("(begin (define a 1) a)");
+
+        REQUIRE(chunk->code[0].op == Instruction::PUSH_CONST);
+        REQUIRE(chunk->code[1].op == Instruction::DEFINE);
+        REQUIRE(chunk->code[2].op == Instruction::POP);
+        REQUIRE(chunk->code[3].op == Instruction::LOAD);
+        REQUIRE(chunk->code[1].a == chunk->code[3].a);
+        REQUIRE(chunk->code[4].op == Instruction::RETURN);
+    }
+
+    {
+        INFO("define of a lambda compiles its body");
+        std::shared_ptr<const Chunk> chunk = compileProgram("(define f (lambda (x y) (+ x y)))");
+
+        REQUIRE(chunk->code[0].op == Instruction::PUSH_CONST);
+        REQUIRE(chunk->code[1].op == Instruction::DEFINE_PROC);
+        REQUIRE(chunk->functions.size() == 1);
+
+        std::shared_ptr<const Chunk> body = chunk->functions[chunk->code[1].b];
+        REQUIRE(body->parameters.size() == 2);
+        REQUIRE(body->parameters[0] == Atom("x"));
+        REQUIRE(body->parameters[1] == Atom("y"));
+        REQUIRE(body->code.back().op == Instruction::RETURN);
+    }
+
+    {
+        INFO("map over a literal list is unrolled");
+        std::shared_ptr<const Chunk> chunk = compileProgram("(map - (list 1 2))");
+
+        REQUIRE(chunk->code[0].op == Instruction::CHECK_PROC);
+        REQUIRE(chunk->code[1].op == Instruction::PUSH_CONST);
+        REQUIRE(chunk->code[2].op == Instruction::CALL);
+        REQUIRE(chunk->code[3].op == Instruction::PUSH_CONST);
+        REQUIRE(chunk->code[4].op == Instruction::CALL);
+        REQUIRE(chunk->code[5].op == Instruction::MAKE_LIST);
+        REQUIRE(chunk->code[5].a == 2);
+    }
+
+    {
+        INFO("map over a range is a loop");
+        std::shared_ptr<const Chunk> chunk = compileProgram("(map - (range 0 1 1))");
+
+        bool hasLoop = false;
+        for(auto & ins : chunk->code){
+            if(ins.op == Instruction::ITER_NEXT){
+                hasLoop = true;
+                REQUIRE(chunk->code[ins.a].op == Instruction::RETURN);
+            }
+        }
+        REQUIRE(hasLoop);
+    }
+
+    {
+        INFO("calls in tail position of a lambda are tail calls");
+        std::shared_ptr<const Chunk> chunk = compileProgram("(define f (lambda (x) (if (< x 1) x (f (- x 1)))))");
+
+        std::shared_ptr<const Chunk> body = chunk->functions[0];
+        REQUIRE(body->code[2].op == Instruction::CALL);
+        REQUIRE(body->code[3].op == Instruction::JUMP_IF_FALSE);
+        REQUIRE(body->code[body->code[3].a - 1].op == Instruction::JUMP);
+
+        std::size_t tailCalls = 0;
+        for(auto & ins : body->code){
+            if(ins.op == Instruction::TAIL_CALL){
+                ++tailCalls;
+                REQUIRE(body->symbols[ins.a] == Atom("f"));
+            }
+        }
+        REQUIRE(tailCalls == 1);
+    }
+}
+
+TEST_CASE( "Test compiling static semantic errors", "[compiler]" ) {
+
+    std::vector<std::string> programs = {"(define a 1 2)",
+        "(define 1 2)",
+        "(define begin 2)",
+        "(lambda (x))",
+        "(apply (+ 1) (list 1))",
+        "(apply + 3)",
+        "(map + 3)",
+        "(if 1 2)",
+        "(1 2 3)"};
+
+    for(auto program : programs){
+        INFO(program);
+        std::shared_ptr<const Chunk> chunk = compileProgram(program);
+
+        bool hasThrow = false;
+        for(auto & ins : chunk->code){
+            hasThrow = hasThrow || (ins.op == Instruction::THROW);
+        }
+        REQUIRE(hasThrow);
+    }
+}
+
+TEST_CASE( "Test folding constants", "[compiler]" ) {
+
+    Environment env;
+
+    auto compileIn = [&env](const std::string & program){
+        std::istringstream iss(program);
+        Expression ast = parse(tokenize(iss));
+        env.declare_definitions(ast);
+        return compile(ast, &env);
+    };
+
+    {
+        INFO("arithmetic over numbers and built-in constants is computed once");
+        std::shared_ptr<const Chunk> chunk = compileIn("(define f (lambda (x) (* x (/ pi (^ 2 1)))))");
+
+        std::shared_ptr<const Chunk> body = chunk->functions[0];
+        REQUIRE(body->code.size() == 4);
+        REQUIRE(body->code[0].op == Instruction::LOAD_SLOT);
+        REQUIRE(body->code[1].op == Instruction::PUSH_CONST);
+        REQUIRE(body->constants[body->code[1].a] == Expression(std::atan2(0, -1) / 2));
+        REQUIRE(body->code[2].op == Instruction::TAIL_CALL);
+
+        INFO("the lambda value keeps its original body");
+        const Expression & lambda = chunk->constants[chunk->code[0].a];
+        std::istringstream original("(* x (/ pi (^ 2 1)))");
+        REQUIRE(lambda.tailAt(1) == parse(tokenize(original)));
+    }
+
+    {
+        INFO("parameters shadow built-in constants");
+        std::shared_ptr<const Chunk> chunk = compileIn("(define g (lambda (pi) (* 2 pi)))");
+
+        std::shared_ptr<const Chunk> body = chunk->functions[0];
+        REQUIRE(body->code[1].op == Instruction::LOAD_SLOT);
+        REQUIRE(body->code[2].op == Instruction::TAIL_CALL);
+    }
+
+    {
+        INFO("calls raising an error are left to run time");
+        std::shared_ptr<const Chunk> chunk = compileIn("(if 1 2 (ln (- 1)))");
+
+        REQUIRE(chunk->code[4].op == Instruction::PUSH_CONST);
+        REQUIRE(chunk->constants[chunk->code[4].a] == Expression(-1.));
+        REQUIRE(chunk->code[5].op == Instruction::CALL);
+    }
+
+    {
+        INFO("symbols defined by a program are not folded from then on");
+        std::shared_ptr<const Chunk> chunk = compileIn("(begin (define e 2) (+ e 1))");
+
+        REQUIRE(!env.is_builtin(Atom("e")));
+        REQUIRE(chunk->code.back().op == Instruction::RETURN);
+        REQUIRE(chunk->code[chunk->code.size() - 2].op == Instruction::CALL);
+        REQUIRE(env.is_builtin(Atom("+")));
+    }
+}
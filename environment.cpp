@@ -1,9 +1,12 @@
 #include "environment.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <functional>
 
 #include "environment.hpp"
+#include "hashcons.hpp"
 #include "semantic_error.hpp"
 
 /*********************************************************************** 
@@ -15,6 +18,131 @@ bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
     return args.size() == nargs;
 }
 
+// the interned id of a built-in name
+SymbolId intern(const std::string & name){
+    return SymbolTable::instance().intern(name);
+}
+
+// predicate, at least one of args is a list
+bool has_list(const std::vector<Expression> & args){
+    for(const auto & a : args){
+        if(a.isHeadList()){
+            return true;
+        }
+    }
+    return false;
+}
+
+// the common length of the list arguments in args
+std::size_t broadcast_length(const std::vector<Expression> & args){
+    
+    bool found = false;
+    std::size_t n = 0;
+    
+    for(const auto & a : args){
+        if(a.isHeadList()){
+            if(found && static_cast<std::size_t>(a.tailSize()) != n){
+                throw SemanticError("Error during evaluation: list arguments of different lengths");
+            }
+            found = true;
+            n = a.tailSize();
+        }
+    }
+    
+    return n;
+}
+
+// predicate, a is a real number or a list of real numbers stored packed
+bool is_packed_real(const Expression & a){
+    if(a.isHeadList()){
+        return (a.tailSize() == 0) || (a.tailNumbers() != nullptr);
+    }
+    return a.isHeadNumber() && (a.tailSize() == 0);
+}
+
+// apply proc elementwise to args, of which at least one is a list. Other
+// arguments are repeated for every element. Elements may be anything proc
+// accepts, including lists, which are broadcast in turn.
+Expression broadcast(const std::vector<Expression> & args, Procedure proc){
+    
+    std::size_t n = broadcast_length(args);
+    
+    Expression result(Atom("list"));
+    std::vector<Expression> elements(args.size());
+    
+    for(std::size_t i = 0; i < n; ++i){
+        for(std::size_t k = 0; k < args.size(); ++k){
+            elements[k] = args[k].isHeadList() ? args[k].tailAt(i) : args[k];
+        }
+        result.append(proc(elements));
+    }
+    
+    return result;
+}
+
+// combine args, real numbers and packed lists of which at least one is a list,
+// left to right with op, elementwise. The loops are kept simple so the
+// compiler can vectorize them.
+template <typename Op>
+Expression fold_packed(const std::vector<Expression> & args, Op op){
+    
+    std::size_t n = broadcast_length(args);
+    std::vector<double> result(n);
+    
+    if(args[0].isHeadList()){
+        std::copy(args[0].tailNumbers(), args[0].tailNumbers() + n, result.begin());
+    }
+    else{
+        std::fill(result.begin(), result.end(), args[0].head().asNumber());
+    }
+    
+    for(std::size_t k = 1; k < args.size(); ++k){
+        if(args[k].isHeadList()){
+            const double * b = args[k].tailNumbers();
+            for(std::size_t i = 0; i < n; ++i){
+                result[i] = op(result[i], b[i]);
+            }
+        }
+        else{
+            const double b = args[k].head().asNumber();
+            for(std::size_t i = 0; i < n; ++i){
+                result[i] = op(result[i], b);
+            }
+        }
+    }
+    
+    return Expression(std::move(result));
+}
+
+// predicate, every one of args is a real number or a packed list
+bool all_packed_real(const std::vector<Expression> & args){
+    return std::all_of(args.begin(), args.end(), is_packed_real);
+}
+
+// apply op to each number of a packed list
+template <typename Op>
+Expression map_packed(const Expression & arg, Op op){
+    
+    std::size_t n = arg.tailSize();
+    const double * a = arg.tailNumbers();
+    std::vector<double> result(n);
+    
+    for(std::size_t i = 0; i < n; ++i){
+        result[i] = op(a[i]);
+    }
+    
+    return Expression(std::move(result));
+}
+
+// predicate, args is a single packed list of numbers that are all at least 0
+bool is_packed_nonnegative(const std::vector<Expression> & args){
+    if(args.size() != 1 || !args[0].isHeadList() || !is_packed_real(args[0])){
+        return false;
+    }
+    const double * a = args[0].tailNumbers();
+    return std::all_of(a, a + args[0].tailSize(), [](double x){ return x >= 0; });
+}
+
 /*********************************************************************** 
  Each of the functions below have the signature that corresponds to the
  typedef'd Procedure function pointer.
@@ -28,6 +156,11 @@ Expression default_proc(const std::vector<Expression> & args){
 
 Expression add(const std::vector<Expression> & args){
     
+    // lists are added elementwise
+    if(has_list(args)){
+        return all_packed_real(args) ? fold_packed(args, std::plus<double>()) : broadcast(args, add);
+    }
+    
     bool complexArg = false;
     
     // check all aruments are numbers, while adding
@@ -57,6 +190,11 @@ Expression add(const std::vector<Expression> & args){
 
 Expression mul(const std::vector<Expression> & args){
     
+    // lists are multiplied elementwise
+    if(has_list(args)){
+        return all_packed_real(args) ? fold_packed(args, std::multiplies<double>()) : broadcast(args, mul);
+    }
+    
     bool complexArg = false;
     bool firstPass = true;
     
@@ -96,6 +234,17 @@ Expression mul(const std::vector<Expression> & args){
 
 Expression subneg(const std::vector<Expression> & args){
     
+    // lists are subtracted or negated elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,1) && all_packed_real(args)){
+            return map_packed(args[0], std::negate<double>());
+        }
+        else if(nargs_equal(args,2) && all_packed_real(args)){
+            return fold_packed(args, std::minus<double>());
+        }
+        return broadcast(args, subneg);
+    }
+    
     bool complexArg = false;
     
     double realResult = 0;
@@ -148,6 +297,17 @@ Expression subneg(const std::vector<Expression> & args){
 
 Expression div(const std::vector<Expression> & args){
     
+    // lists are divided elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,1) && all_packed_real(args)){
+            return map_packed(args[0], [](double x){ return 1 / x; });
+        }
+        else if(nargs_equal(args,2) && all_packed_real(args)){
+            return fold_packed(args, std::divides<double>());
+        }
+        return broadcast(args, div);
+    }
+    
     bool complexArg = false;
     
     std::complex<double> complexResult;
@@ -198,6 +358,15 @@ Expression div(const std::vector<Expression> & args){
 
 Expression sqrt(const std::vector<Expression> & args){
     
+    // the square root of a negative number is complex, so only lists of
+    // non-negative numbers stay packed
+    if(has_list(args)){
+        if(is_packed_nonnegative(args)){
+            return map_packed(args[0], [](double x){ return std::sqrt(x); });
+        }
+        return broadcast(args, sqrt);
+    }
+    
     bool complexArg = false;
     
     double realResult = 0;
@@ -239,6 +408,14 @@ Expression sqrt(const std::vector<Expression> & args){
 
 Expression power(const std::vector<Expression> & args){
     
+    // lists are raised elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,2) && all_packed_real(args)){
+            return fold_packed(args, [](double x, double y){ return std::pow(x, y); });
+        }
+        return broadcast(args, power);
+    }
+    
     bool complexArg = false;
     
     std::complex<double> complexResult;
@@ -276,6 +453,14 @@ Expression power(const std::vector<Expression> & args){
 
 Expression ln(const std::vector<Expression> & args){
     
+    // the log of a negative number is an error, raised by the generic path
+    if(has_list(args)){
+        if(is_packed_nonnegative(args)){
+            return map_packed(args[0], [](double x){ return std::log(x); });
+        }
+        return broadcast(args, ln);
+    }
+    
     double result = 0;
     
     if(nargs_equal(args,1)){
@@ -294,8 +479,36 @@ Expression ln(const std::vector<Expression> & args){
     return Expression(result);
 };
 
+Expression less(const std::vector<Expression> & args){
+    
+    double result = 0;
+    
+    if(nargs_equal(args,2)){
+        if (args[0].isHeadNumber() && args[1].isHeadNumber()){
+            // true is 1, false is 0
+            result = (args[0].head().asNumber() < args[1].head().asNumber()) ? 1 : 0;
+        }
+        else {
+            throw SemanticError("Error in call to less: argument not a real number");
+        }
+    }
+    else {
+        throw SemanticError("Error in call to less: invalid number of arguments");
+    }
+    
+    return Expression(result);
+};
+
 Expression sin(const std::vector<Expression> & args){
     
+    // lists are mapped elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,1) && all_packed_real(args)){
+            return map_packed(args[0], [](double x){ return std::sin(x); });
+        }
+        return broadcast(args, sin);
+    }
+    
     double result = 0;
     
     if(nargs_equal(args,1)){
@@ -316,6 +529,14 @@ Expression sin(const std::vector<Expression> & args){
 
 Expression cos(const std::vector<Expression> & args){
     
+    // lists are mapped elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,1) && all_packed_real(args)){
+            return map_packed(args[0], [](double x){ return std::cos(x); });
+        }
+        return broadcast(args, cos);
+    }
+    
     double result = 0;
     
     if(nargs_equal(args,1)){
@@ -336,6 +557,14 @@ Expression cos(const std::vector<Expression> & args){
 
 Expression tan(const std::vector<Expression> & args){
     
+    // lists are mapped elementwise
+    if(has_list(args)){
+        if(nargs_equal(args,1) && all_packed_real(args)){
+            return map_packed(args[0], [](double x){ return std::tan(x); });
+        }
+        return broadcast(args, tan);
+    }
+    
     double result = 0;
     
     if(nargs_equal(args,1)){
@@ -448,15 +677,10 @@ Expression first(const std::vector<Expression> & args){
     
     Expression result;
     
-    std::list<Expression> results;
-    
     if(nargs_equal(args,1)){
         if(args[0].isHeadList()){
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                results.push_back(*i);
-            }
-            if (!results.empty()){
-                result = results.front();
+            if (args[0].tailSize() != 0){
+                result = args[0].tailAt(0);
             } else {
                 throw SemanticError("Error: argument to first is an empty list");
             }
@@ -473,22 +697,16 @@ Expression first(const std::vector<Expression> & args){
 
 Expression rest(const std::vector<Expression> & args){
     
-    bool listEmpty = true;
     Expression result;
-    result.setHead(Atom("list"));
     
     if(nargs_equal(args,1)){
         if(args[0].isHeadList()){
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                if (i != args[0].tailConstBegin()){
-                    result.append(*i);
-                }
-                listEmpty = false;
-            }
-            
-            if(listEmpty){
+            if(args[0].tailSize() == 0){
                 throw SemanticError("Error: argument to rest is an empty list");
             }
+            
+            // shares the remaining elements with the argument
+            result = args[0].rest();
         } else {
             throw SemanticError("Error: argument to rest is not a list");
         }
@@ -504,14 +722,9 @@ Expression length(const std::vector<Expression> & args){
     
     size_t result;
     
-    std::list<Expression> results;
-    
     if(nargs_equal(args,1)){
         if(args[0].isHeadList()){
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                results.push_back(*i);
-            }
-            result = results.size();
+            result = args[0].tailSize();
         } else {
             throw SemanticError("Error: argument to length is not a list");
         }
@@ -530,8 +743,8 @@ Expression append(const std::vector<Expression> & args){
     
     if(nargs_equal(args,2)){
         if(args[0].isHeadList()){
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                result.append(*i);
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[0].tailSize()); i++){
+                result.append(args[0].tailAt(i));
             }
             
             if (args[1].isHeadComplex()){
@@ -559,13 +772,13 @@ Expression join(const std::vector<Expression> & args){
     if(nargs_equal(args,2)){
         if(args[0].isHeadList() && args[1].isHeadList()){
             // Append list 1 to result
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                result.append(*i);
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[0].tailSize()); i++){
+                result.append(args[0].tailAt(i));
             }
             
             // Append list 2 to result
-            for (Expression::ConstIteratorType i = args[1].tailConstBegin(); i != args[1].tailConstEnd(); i++){
-                result.append(*i);
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[1].tailSize()); i++){
+                result.append(args[1].tailAt(i));
             }
         } else {
             throw SemanticError("Error: argument to join is not a list");
@@ -580,8 +793,8 @@ Expression join(const std::vector<Expression> & args){
 
 Expression range(const std::vector<Expression> & args){
     
-    Expression result;
-    result.setHead(Atom("list"));
+    // the numbers are stored packed
+    std::vector<double> numbers;
     
     if(nargs_equal(args,3)){
         if (!args[0].isHeadNumber() || !args[1].isHeadNumber() || !args[2].isHeadNumber()){
@@ -596,7 +809,7 @@ Expression range(const std::vector<Expression> & args){
             double increment = args[2].head().asNumber();
             
             for (double i = begin; i <= end; i += increment){
-                result.append(i);
+                numbers.push_back(i);
             }
             
         }
@@ -605,7 +818,7 @@ Expression range(const std::vector<Expression> & args){
         throw SemanticError("Error: wrong number of arguments in call to range");
     }
     
-    return result;
+    return Expression(std::move(numbers));
 };
 
 Expression setproperty(const std::vector<Expression> & args){
@@ -625,7 +838,7 @@ Expression setproperty(const std::vector<Expression> & args){
         throw SemanticError("Error: wrong number of arguments in call to set-property");
     }
     
-    return result;
+    return share(result);
 };
 
 Expression getproperty(const std::vector<Expression> & args){
@@ -636,9 +849,7 @@ Expression getproperty(const std::vector<Expression> & args){
         if (!args[0].isHeadString()){
             throw SemanticError("Error: first argument to get-property not a string");
         } else {
-            Expression exp = args[1];
-            
-            result = exp.get_property(args[0]);
+            result = args[1].get_property(args[0]);
         }
     }
     else {
@@ -660,24 +871,23 @@ Expression discretePlot(const std::vector<Expression> & args){
             throw SemanticError("Error: second argument to discrete-plot is not a list");
         } else {
             // Add all options as properties to expression
-            for (Expression::ConstIteratorType i = args[1].tailConstBegin(); i != args[1].tailConstEnd(); i++){
-                std::vector<Expression> options;
-                
-                for (Expression::ConstIteratorType j = i->tailConstBegin(); j != i->tailConstEnd(); j++){
-                    options.emplace_back(*j);
-                }
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[1].tailSize()); i++){
+                // each option is a (key value) list
+                Expression option = args[1].tailAt(i);
+                Expression key = option.tailAt(0);
+                Expression value = option.tailAt(1);
                 
                 // Add property to result
-                result.add_property(options[0], options[1]);
+                result.add_property(key, value);
                 
             }
             
             
             // Add all data as points
-            for (Expression::ConstIteratorType i = args[0].tailConstBegin(); i != args[0].tailConstEnd(); i++){
-                Expression point = *i;
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[0].tailSize()); i++){
+                Expression point = args[0].tailAt(i);
                 point.add_property(Expression(Atom("\"object-name\"")), Expression(Atom("\"point\"")));
-                result.append(point);
+                result.append(std::move(point));
                 
             }
         }
@@ -686,7 +896,7 @@ Expression discretePlot(const std::vector<Expression> & args){
         throw SemanticError("Error: wrong number of arguments in call to discrete-plot");
     }
     
-    return result;
+    return share(result);
 };
 
 Expression continuousPlot(const std::vector<Expression> & args){
@@ -703,22 +913,21 @@ Expression continuousPlot(const std::vector<Expression> & args){
             throw SemanticError("Error: second argument to continuous-plot is not a list");
         } else {
             // Add all options as properties to expression
-            for (Expression::ConstIteratorType i = args[2].tailConstBegin(); i != args[2].tailConstEnd(); i++){
-                std::vector<Expression> options;
-                
-                for (Expression::ConstIteratorType j = i->tailConstBegin(); j != i->tailConstEnd(); j++){
-                    options.emplace_back(*j);
-                }
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[2].tailSize()); i++){
+                // each option is a (key value) list
+                Expression option = args[2].tailAt(i);
+                Expression key = option.tailAt(0);
+                Expression value = option.tailAt(1);
                 
                 // Add property to result
-                result.add_property(options[0], options[1]);
+                result.add_property(key, value);
                 
             }
             
             
             // Add all data as points
-            for (Expression::ConstIteratorType i = args[1].tailConstBegin(); i != args[1].tailConstEnd(); i++){
-                result.append(*i);
+            for (std::size_t i = 0; i < static_cast<std::size_t>(args[1].tailSize()); i++){
+                result.append(args[1].tailAt(i));
             }
         }
     }
@@ -726,53 +935,227 @@ Expression continuousPlot(const std::vector<Expression> & args){
         throw SemanticError("Error: wrong number of arguments in call to continuous-plot");
     }
     
-    return result;
+    return share(result);
+};
+
+// copy the frames of a closure that are in the arena to ordinary storage
+std::shared_ptr<const Frame> promote(const std::shared_ptr<const Frame> & frame, const Arena & arena){
+    
+    if(!frame || !arena.owns(frame.get())){
+        return frame;
+    }
+    
+    std::shared_ptr<Frame> copy = std::make_shared<Frame>(*frame);
+    copy->parent = promote(frame->parent, arena);
+    return copy;
+}
+
+// the parameter names of a lambda expression
+std::shared_ptr<const std::vector<Atom>> parameter_names(const Expression & lambda){
+    
+    std::shared_ptr<std::vector<Atom>> names = std::make_shared<std::vector<Atom>>();
+    
+    if(lambda.tailSize() > 0){
+        const Expression & parameters = *lambda.tailConstBegin();
+        for(auto it = parameters.tailConstBegin(); it != parameters.tailConstEnd(); ++it){
+            if(it->isHeadSymbol()){
+                names->push_back(it->head());
+            }
+        }
+    }
+    
+    return names;
+}
+
+// predicate, sym names a special-form rather than something in the environment
+bool is_special_form(SymbolId sym){
+    
+    switch(sym){
+        case SymbolTable::BEGIN:
+        case SymbolTable::IF:
+        case SymbolTable::DEFINE:
+        case SymbolTable::LAMBDA:
+        case SymbolTable::APPLY:
+        case SymbolTable::MAP:
+        case SymbolTable::PMAP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// record what evaluating exp may do: whether it contains a define and which
+// symbols other than locals it looks up or calls
+void collect_effects(const Expression & exp, const std::vector<SymbolId> & locals,
+                     bool & defines, std::vector<SymbolId> & references){
+    
+    const Atom & head = exp.head();
+    
+    // the body of a nested lambda is not run by evaluating it, only by a call
+    // after it has been bound by a define, which is recorded below
+    if(head.isLambda()){
+        return;
+    }
+    
+    bool skipFirst = false;
+    
+    if(head.isSymbol()){
+        if(head.asSymbolId() == SymbolTable::DEFINE){
+            defines = true;
+            skipFirst = true;
+        }
+        else if(!is_special_form(head.asSymbolId())){
+            SymbolId id = head.asSymbolId();
+            if(std::find(locals.begin(), locals.end(), id) == locals.end() &&
+               std::find(references.begin(), references.end(), id) == references.end()){
+                references.push_back(id);
+            }
+        }
+    }
+    
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        if(skipFirst){
+            skipFirst = false;
+            continue;
+        }
+        collect_effects(*it, locals, defines, references);
+    }
+}
+
+// add the symbols exp binds with define, anywhere in it, to defined
+void collect_definitions(const Expression & exp, std::vector<SymbolId> & defined){
+    
+    const Atom & head = exp.head();
+    
+    if(head.asSymbolId() == SymbolTable::DEFINE && exp.tailSize() > 0 &&
+       exp.tailAt(0).isHeadSymbol()){
+        defined.push_back(exp.tailAt(0).head().asSymbolId());
+    }
+    
+    for(auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); ++it){
+        collect_definitions(*it, defined);
+    }
+}
+
+// a built-in procedure and the name it is bound to
+struct Builtin {
+    const char * name;
+    Procedure proc;
+};
+
+// the built-in procedures of the default environment
+constexpr Builtin BUILTINS[] = {
+    {"+", add},
+    {"-", subneg},
+    {"*", mul},
+    {"/", div},
+    {"sqrt", sqrt},
+    {"^", power},
+    {"ln", ln},
+    {"<", less},
+    {"sin", sin},
+    {"cos", cos},
+    {"tan", tan},
+    {"real", realPart},
+    {"imag", imagPart},
+    {"mag", mag},
+    {"arg", arg},
+    {"conj", conj},
+    {"first", first},
+    {"rest", rest},
+    {"length", length},
+    {"append", append},
+    {"join", join},
+    {"range", range},
+    {"set-property", setproperty},
+    {"get-property", getproperty},
+    {"discrete-plot", discretePlot},
+    {"continuous-plot", continuousPlot}
 };
 
 const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const std::complex<double> I (0.0, 1.0);
 
-Environment::Environment(){
+// return a generation number not used by any environment before
+std::size_t next_generation(){
+    
+    static std::atomic<std::size_t> generations(0);
+    return ++generations;
+}
+
+CallCache::CallCache() noexcept: version(0), symbol(0), proc(nullptr){}
+
+CallCache::CallCache(const CallCache &) noexcept: CallCache(){}
+
+CallCache & CallCache::operator=(const CallCache &) noexcept{
+    
+    version = 0;
+    return *this;
+}
+
+Environment::Environment(): generation(0), purities_checked(0), depth(0){
     
     reset();
 }
 
+Environment::Environment(const Environment & other):
+envmap(other.envmap), generation(other.generation), purities_checked(0), depth(0){}
+
+void Environment::restore(const Environment & snapshot){
+    
+    envmap = snapshot.envmap;
+    generation = snapshot.generation;
+    frame.reset();
+    depth = 0;
+    arena.reset();
+    
+    if(memo){
+        memo->clear();
+    }
+}
+
+SymbolMap<Environment::EnvResult> & Environment::modify(){
+    
+    // another environment shares the map, which it must not see change
+    if(envmap.use_count() != 1){
+        envmap = std::make_shared<SymbolMap<EnvResult>>(*envmap);
+    }
+    
+    return *envmap;
+}
+
 bool Environment::is_known(const Atom & sym) const{
     if(!sym.isSymbol()) return false;
     
-    return envmap.find(sym.asSymbol()) != envmap.end();
+    return envmap->find(sym.asSymbolId()) != nullptr;
 }
 
 bool Environment::is_lambda(const Atom & sym) const{
     if(!is_known(sym)) return false;
     
-    auto result = envmap.find(sym.asSymbol());
+    auto result = envmap->find(sym.asSymbolId());
     
-    return (result->second.exp.isHeadLambda());
+    return (result->exp.isHeadLambda());
 }
 
 bool Environment::is_exp(const Atom & sym) const{
     if(!sym.isSymbol()) return false;
     
-    auto result = envmap.find(sym.asSymbol());
-    return (result != envmap.end()) && (result->second.type == ExpressionType);
+    auto result = envmap->find(sym.asSymbolId());
+    return (result != nullptr) && (result->type == ExpressionType);
 }
 
 Expression Environment::get_exp(const Atom & sym) const{
     
-    Expression exp;
-    
     if(sym.isSymbol()){
-        auto result = envmap.find(sym.asSymbol());
-        if((result != envmap.end()) && (result->second.type == ExpressionType)){
-            exp = result->second.exp;
-        } else if((result != envmap.end()) && (result->second.type == ProcedureType)){
-            exp = result->second.exp;
+        auto result = envmap->find(sym.asSymbolId());
+        if(result != nullptr){
+            return result->exp;
         }
     }
     
-    return exp;
+    return Expression();
 }
 
 void Environment::add_exp(const Atom & sym, const Expression & exp){
@@ -781,20 +1164,63 @@ void Environment::add_exp(const Atom & sym, const Expression & exp){
         throw SemanticError("Attempt to add non-symbol to environment");
     }
     
-    // error if overwriting symbol map
-    if(envmap.find(sym.asSymbol()) != envmap.end()){
-        // throw SemanticError("Attempt to overwrite symbol in environemnt");
-        envmap.erase(sym.asSymbol());
+    forget(sym.asSymbolId());
+    
+    modify().insert(sym.asSymbolId(), EnvResult(ExpressionType, exp));
+    generation = next_generation();
+}
+
+void Environment::forget(SymbolId sym){
+    
+    auto result = envmap->find(sym);
+    if(result == nullptr){
+        return;
     }
     
-    envmap.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp));
+    // a Pure lambda may call the procedure, so results cached for it may
+    // no longer hold
+    if(memo && result->type == ProcedureType){
+        memo->clear();
+    }
+    
+    modify().erase(sym);
+}
+
+bool Environment::is_builtin(const Atom & sym) const{
+    if(!sym.isSymbol()) return false;
+    
+    auto result = envmap->find(sym.asSymbolId());
+    return (result != nullptr) && result->builtin;
+}
+
+void Environment::declare_definitions(const Expression & program){
+    
+    std::vector<SymbolId> defined;
+    collect_definitions(program, defined);
+    
+    bool changed = false;
+    for(SymbolId id : defined){
+        const EnvResult * result = envmap->find(id);
+        if(result != nullptr && result->builtin){
+            modify().find(id)->builtin = false;
+            changed = true;
+        }
+    }
+    
+    // compiled lambda bodies may have folded the old definitions, they are
+    // compiled again when next called
+    if(changed){
+        for(auto & entry : modify()){
+            entry.second.code.reset();
+        }
+    }
 }
 
 bool Environment::is_proc(const Atom & sym) const{
     if(!sym.isSymbol()) return false;
     
-    auto result = envmap.find(sym.asSymbol());
-    return (result != envmap.end()) && (result->second.type == ProcedureType);
+    auto result = envmap->find(sym.asSymbolId());
+    return (result != nullptr) && (result->type == ProcedureType);
 }
 
 Procedure Environment::get_proc(const Atom & sym) const{
@@ -802,118 +1228,278 @@ Procedure Environment::get_proc(const Atom & sym) const{
     //Procedure proc = default_proc;
     
     if(sym.isSymbol()){
-        auto result = envmap.find(sym.asSymbol());
-        if((result != envmap.end()) && (result->second.type == ProcedureType)){
-            return result->second.proc;
+        auto result = envmap->find(sym.asSymbolId());
+        if((result != nullptr) && (result->type == ProcedureType)){
+            return result->proc;
         }
     }
     
     return default_proc;
 }
 
-void Environment::add_proc(const Atom & sym, const Expression & proc){
+void Environment::add_proc(const Atom & sym, const Expression & proc, std::shared_ptr<const Chunk> code,
+                           std::shared_ptr<const Frame> closure){
     
     if(!sym.isSymbol()){
         throw SemanticError("Attempt to add non-symbol to environment");
     }
     
-    // error if overwriting symbol map
-    if(envmap.find(sym.asSymbol()) != envmap.end()){
-        envmap.erase(sym.asSymbol());
+    forget(sym.asSymbolId());
+    
+    EnvResult result(ProcedureType, proc, code, promote(closure, arena));
+    result.parameters = parameter_names(proc);
+    
+    // the parameters of the lambda and of the calls enclosing its definition
+    // are bound in frames, not looked up globally
+    std::vector<SymbolId> locals;
+    for(const Atom & name : *result.parameters){
+        locals.push_back(name.asSymbolId());
     }
+    for(const Frame * f = closure.get(); f != nullptr; f = f->parent.get()){
+        if(f->names){
+            for(const Atom & name : *f->names){
+                locals.push_back(name.asSymbolId());
+            }
+        }
+    }
+    
+    std::shared_ptr<Effects> effects = std::make_shared<Effects>();
+    effects->defines = false;
+    if(proc.tailSize() > 1){
+        collect_effects(proc.tailAt(1), locals, effects->defines, effects->references);
+    }
+    result.effects = effects;
     
-    envmap.emplace(sym.asSymbol(), EnvResult(ProcedureType, proc));
+    modify().insert(sym.asSymbolId(), std::move(result));
+    generation = next_generation();
 }
 
-/*
- Reset the environment to the default state. First remove all entries and
- then re-add the default ones.
- */
-void Environment::reset(){
+Procedure Environment::get_builtin(const Atom & sym, CallCache & cache) const{
+    
+    SymbolId id = sym.asSymbolId();
+    
+    // the entry holds if its version, read before and after its values, is
+    // the generation of this environment
+    std::size_t version = cache.version.load();
+    if(version == generation){
+        SymbolId cached = cache.symbol.load();
+        Procedure proc = cache.proc.load();
+        if(cached == id && cache.version.load() == version){
+            return proc;
+        }
+    }
+    
+    Procedure proc = nullptr;
+    if(sym.isSymbol()){
+        auto result = envmap->find(id);
+        if((result != nullptr) && (result->type == ProcedureType) &&
+           !result->exp.isHeadLambda()){
+            proc = result->proc;
+        }
+    }
     
-    envmap.clear();
+    // refill the entry, unless another thread is doing so
+    if(version != CallCache::FILLING && cache.version.compare_exchange_strong(version, CallCache::FILLING)){
+        cache.symbol.store(id);
+        cache.proc.store(proc);
+        cache.version.store(generation);
+    }
     
-    // Built-In value of pi
-    envmap.emplace("pi", EnvResult(ExpressionType, Expression(PI)));
+    return proc;
+}
+
+std::shared_ptr<const Chunk> Environment::get_code(const Atom & sym) const{
     
-    // Built-In value of e
-    envmap.emplace("e", EnvResult(ExpressionType, Expression(EXP)));
+    if(sym.isSymbol()){
+        auto result = envmap->find(sym.asSymbolId());
+        if((result != nullptr) && (result->type == ProcedureType)){
+            return result->code;
+        }
+    }
     
-    // Built-In value of I
-    envmap.emplace("I", EnvResult(ExpressionType, Expression(I)));
+    return nullptr;
+}
+
+std::shared_ptr<const Frame> Environment::get_closure(const Atom & sym) const{
     
-    // Procedure: add;
-    envmap.emplace("+", EnvResult(ProcedureType, add));
+    if(sym.isSymbol()){
+        auto result = envmap->find(sym.asSymbolId());
+        if((result != nullptr) && (result->type == ProcedureType)){
+            return result->closure;
+        }
+    }
     
-    // Procedure: subneg;
-    envmap.emplace("-", EnvResult(ProcedureType, subneg));
+    return nullptr;
+}
+
+std::shared_ptr<const std::vector<Atom>> Environment::get_parameters(const Atom & sym) const{
     
-    // Procedure: mul;
-    envmap.emplace("*", EnvResult(ProcedureType, mul));
+    if(sym.isSymbol()){
+        auto result = envmap->find(sym.asSymbolId());
+        if((result != nullptr) && (result->type == ProcedureType)){
+            return result->parameters;
+        }
+    }
     
-    // Procedure: div;
-    envmap.emplace("/", EnvResult(ProcedureType, div));
+    return nullptr;
+}
+
+Environment::Purity Environment::get_purity(const Atom & sym) const{
     
-    // Procedure: sqrt;
-    envmap.emplace("sqrt", EnvResult(ProcedureType, sqrt));
+    if(!is_proc(sym)){
+        return WritesGlobals;
+    }
+    
+    const EnvResult & entry = *envmap->find(sym.asSymbolId());
     
-    // Procedure: pow;
-    envmap.emplace("^", EnvResult(ProcedureType, power));
+    // built-in procedures have no side effects
+    if(!entry.effects){
+        return Pure;
+    }
+    
+    if(purities_checked != generation){
+        purities.clear();
+        purities_checked = generation;
+    }
     
-    // Procedure: ln;
-    envmap.emplace("ln", EnvResult(ProcedureType, ln));
+    const Purity * cached = purities.find(sym.asSymbolId());
+    if(cached != nullptr){
+        return *cached;
+    }
+    
+    std::vector<SymbolId> visiting;
+    return purities.insert(sym.asSymbolId(), resolve(sym.asSymbolId(), visiting));
+}
+
+Environment::Purity Environment::resolve(SymbolId id, std::vector<SymbolId> & visiting) const{
     
-    // Procedure: sin;
-    envmap.emplace("sin", EnvResult(ProcedureType, sin));
+    // a lambda is visited once, so recursion ends and each body is examined
+    // once however many of the others call it
+    visiting.push_back(id);
     
-    // Procedure: cos;
-    envmap.emplace("cos", EnvResult(ProcedureType, cos));
+    const Effects & effects = *envmap->find(id)->effects;
+    Purity purity = effects.defines ? WritesGlobals : Pure;
     
-    // Procedure: tan;
-    envmap.emplace("tan", EnvResult(ProcedureType, tan));
+    for(SymbolId ref : effects.references){
+        if(purity == WritesGlobals){
+            break;
+        }
+        if(std::find(visiting.begin(), visiting.end(), ref) != visiting.end()){
+            continue;
+        }
+        
+        auto result = envmap->find(ref);
+        if(result == nullptr || result->type == ExpressionType){
+            // a global value, or a symbol that may be defined later
+            purity = std::max(purity, ReadsGlobals);
+        }
+        else if(result->effects){
+            purity = std::max(purity, resolve(ref, visiting));
+        }
+    }
+    
+    return purity;
+}
+
+std::shared_ptr<const Frame> Environment::get_frame() const{
     
-    // Procedure: real;
-    envmap.emplace("real", EnvResult(ProcedureType, realPart));
+    return frame;
+}
+
+void Environment::set_frame(std::shared_ptr<const Frame> f){
     
-    // Procedure: imag;
-    envmap.emplace("imag", EnvResult(ProcedureType, imagPart));
+    frame = f;
+}
+
+std::size_t Environment::get_depth() const noexcept{
     
-    // Procedure: mag;
-    envmap.emplace("mag", EnvResult(ProcedureType, mag));
+    return depth;
+}
+
+void Environment::set_depth(std::size_t d) noexcept{
     
-    // Procedure: arg;
-    envmap.emplace("arg", EnvResult(ProcedureType, arg));
+    depth = d;
+}
+
+void Environment::set_memo_capacity(std::size_t capacity){
     
-    // Procedure: conj;
-    envmap.emplace("conj", EnvResult(ProcedureType, conj));
+    if(capacity == 0){
+        memo.reset();
+    }
+    else{
+        memo.reset(new MemoCache(capacity));
+    }
+}
+
+MemoCache * Environment::get_memo() const{
     
-    // Procedure: first;
-    envmap.emplace("first", EnvResult(ProcedureType, first));
+    return memo.get();
+}
+
+Arena & Environment::get_arena(){
     
-    // Procedure: rest;
-    envmap.emplace("rest", EnvResult(ProcedureType, rest));
+    return arena;
+}
+
+/*
+ Reset the environment to the default state, replacing all entries with the
+ default ones.
+ */
+void Environment::reset(){
     
-    // Procedure: length;
-    envmap.emplace("length", EnvResult(ProcedureType, length));
+    frame.reset();
+    depth = 0;
+    arena.reset();
+    generation = next_generation();
     
-    // Procedure: append;
-    envmap.emplace("append", EnvResult(ProcedureType, append));
+    if(memo){
+        memo->clear();
+    }
     
-    // Procedure: join;
-    envmap.emplace("join", EnvResult(ProcedureType, join));
+    // the default entries are built once and shared until changed
+    envmap = defaults();
+}
+
+std::vector<Atom> Environment::definitions() const{
     
-    // Procedure: range;
-    envmap.emplace("range", EnvResult(ProcedureType, range));
+    std::vector<Atom> names;
+    for(const auto & entry : *envmap){
+        const EnvResult & result = entry.second;
+        if(!result.builtin && (result.type == ExpressionType || result.exp.isHeadLambda())){
+            names.emplace_back(SymbolTable::instance().name(entry.first));
+        }
+    }
     
-    // Procedure: set-property;
-    envmap.emplace("set-property", EnvResult(ProcedureType, setproperty));
+    std::sort(names.begin(), names.end(), [](const Atom & a, const Atom & b){
+        return a.asSymbol() < b.asSymbol();
+    });
     
-    // Procedure: get-property;
-    envmap.emplace("get-property", EnvResult(ProcedureType, getproperty));
+    return names;
+}
+
+const std::shared_ptr<SymbolMap<Environment::EnvResult>> & Environment::defaults(){
     
-    // Procedure: discrete-plot;
-    envmap.emplace("discrete-plot", EnvResult(ProcedureType, discretePlot));
+    // initialization of a local static is thread-safe. The table holds a
+    // reference, so the entries are never changed in place.
+    static const std::shared_ptr<SymbolMap<EnvResult>> table = std::make_shared<SymbolMap<EnvResult>>([](){
+        
+        SymbolMap<EnvResult> entries;
+        
+        // Built-In values of pi, e and I
+        entries.insert(intern("pi"), EnvResult(ExpressionType, Expression(PI)));
+        entries.insert(intern("e"), EnvResult(ExpressionType, Expression(EXP)));
+        entries.insert(intern("I"), EnvResult(ExpressionType, Expression(I)));
+        
+        for(const Builtin & builtin : BUILTINS){
+            entries.insert(intern(builtin.name), EnvResult(ProcedureType, builtin.proc));
+        }
+        
+        for(auto & entry : entries){
+            entry.second.builtin = true;
+        }
+        
+        return entries;
+    }());
     
-    // Procedure: continuous-plot;
-    envmap.emplace("continuous-plot", EnvResult(ProcedureType, continuousPlot));
+    return table;
 }
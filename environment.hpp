@@ -11,11 +11,16 @@
 #define ENVIRONMENT_HPP
 
 // system includes
-#include <map>
+#include <atomic>
+#include <memory>
+#include <utility>
 
 // module includes
+#include "arena.hpp"
 #include "atom.hpp"
 #include "expression.hpp"
+#include "memo.hpp"
+#include "symbol_map.hpp"
 
 /*! \typedef Procedure
  \brief A Procedure is a C++ function pointer taking a vector of
@@ -23,6 +28,67 @@
  */
 typedef Expression (*Procedure)(const std::vector<Expression> & args);
 
+/*! \class CallCache
+ \brief An inline cache of the built-in procedure a call site resolved to.
+
+ A call site, i.e. a call node of the tree walker or a symbol of a compiled
+ chunk, keeps one to resolve its procedure with Environment::get_builtin. The
+ entry holds for the generation of the environment it was filled in. Any
+ definition changes the generation, which invalidates every entry at once.
+
+ Entries may be shared between threads evaluating in copies of an environment
+ (see parallel_map), so they are read and filled atomically. Copies start
+ empty.
+ */
+class CallCache {
+public:
+
+    CallCache() noexcept;
+    CallCache(const CallCache &) noexcept;
+    CallCache & operator=(const CallCache &) noexcept;
+
+private:
+    friend class Environment;
+
+    // value of version while an entry is being filled
+    static const std::size_t FILLING = ~std::size_t(0);
+
+    // the generation the entry holds for, 0 if empty
+    std::atomic<std::size_t> version;
+
+    // the symbol called and the built-in it maps to, nullptr if it is not one
+    std::atomic<SymbolId> symbol;
+    std::atomic<Procedure> proc;
+};
+
+// forward declare Chunk, the compiled body of a lambda (see compiler.hpp)
+struct Chunk;
+
+/*! \class Frame
+ \brief An activation frame: the argument values of one lambda call.
+ 
+ Lambda parameters are bound in a frame rather than in the global mapping, so
+ a call never disturbs bindings outside of it. A lambda defined inside the body
+ of another captures the frame of that call as its parent, which is how it sees
+ the parameters of the enclosing lambda after that call has returned.
+ 
+ Frames are immutable once created and shared via std::shared_ptr.
+ */
+struct Frame {
+    /// the argument values, in parameter order
+    std::vector<Expression> slots;
+    
+    /// the parameter names, in the same order as slots
+    std::shared_ptr<const std::vector<Atom>> names;
+    
+    /// the frame of the enclosing lambda, nullptr at global scope
+    std::shared_ptr<const Frame> parent;
+};
+
+/// the deepest nesting of lambda calls, not counting tail calls, before
+/// either evaluator aborts the evaluation
+const std::size_t MAX_CALL_DEPTH = 100000;
+
 /*! \class Environment
  \brief A class representing the interpreter environment.
  
@@ -39,10 +105,39 @@ typedef Expression (*Procedure)(const std::vector<Expression> & args);
  */
 class Environment {
 public:
+    
+    /*! \enum Purity
+     \brief What calling a procedure may do besides computing its result.
+     */
+    enum Purity { Pure,         //< the result depends only on the arguments
+                  ReadsGlobals, //< the result may depend on global definitions
+                  WritesGlobals //< the call may add or change global definitions
+    };
+    
     /*! Construct the default environment with built-in procedures and
      * definitions. */
     Environment();
     
+    /*! Construct an environment with the same definitions as other, to
+     evaluate independently of it (e.g. in another thread). The copy starts at
+     global scope with an empty arena, and memoization disabled.
+     
+     Copying takes constant time: the definitions are shared, and copied only
+     when either environment first changes them. A copy therefore serves as a
+     snapshot to restore or to start other environments from.
+     \param other the environment to copy
+     */
+    Environment(const Environment & other);
+    
+    Environment & operator=(const Environment &) = delete;
+    
+    /*! Replace the definitions with those of snapshot, in constant time. The
+     environment returns to global scope, its arena is released and its
+     memoized results, if any, are discarded.
+     \param snapshot the environment to take the definitions from
+     */
+    void restore(const Environment & snapshot);
+    
     /*! Determine if a symbol is known to the environment.
      \param sym the sumbol to lookup
      \return true if the symbol has been defined in the environment
@@ -74,6 +169,22 @@ public:
      */
     void add_exp(const Atom &sym, const Expression &exp);
     
+    /*! Determine if a symbol still has its built-in definition, and no
+     program declared with declare_definitions may change it. The value of
+     such a symbol, or of a call to it, may be computed before it is needed.
+     \param sym the symbol to lookup
+     \return true if sym is built-in and can not be redefined
+     */
+    bool is_builtin(const Atom &sym) const;
+    
+    /*! Declare a program that is about to be evaluated. The built-in symbols
+     it defines anywhere, including in the bodies of its lambdas, are no
+     longer reported by is_builtin, and the compiled bodies of lambdas, which
+     may have relied on them, are discarded.
+     \param program the parsed program
+     */
+    void declare_definitions(const Expression & program);
+    
     /*! Determine if a symbol has been defined as a procedure
      \param sym the symbol to lookup
      \return true if thr symbol maps to a procedure
@@ -92,30 +203,169 @@ public:
     /*! Add a mapping from sym argument to the proc argument within the environment.
      \param sym the symbol to add
      \param proc the procedure the symbol should map to
+     \param code the compiled body of proc, if it has been compiled
+     \param closure the frame proc was defined in, nullptr at global scope.
+     Frames in the arena are copied out of it, as the closure outlives the
+     evaluation.
      */
-    void add_proc(const Atom &sym, const Expression &proc);
+    void add_proc(const Atom &sym, const Expression &proc, std::shared_ptr<const Chunk> code = nullptr,
+                  std::shared_ptr<const Frame> closure = nullptr);
+    
+    /*! Get the built-in procedure the argument symbol maps to, through the
+     inline cache of the call site. While no definition is added the cache
+     answers without a lookup.
+     \param sym the symbol to lookup
+     \param cache the cache of the call site
+     \return the procedure, or nullptr if sym maps to a lambda or not to a
+     procedure at all
+     */
+    Procedure get_builtin(const Atom &sym, CallCache & cache) const;
+    
+    /*! Get the compiled body of the lambda the argument symbol maps to
+     \param sym the symbol to lookup
+     \return the compiled body, or nullptr if sym is not a compiled lambda
+     */
+    std::shared_ptr<const Chunk> get_code(const Atom &sym) const;
+    
+    /*! Get the frame the lambda the argument symbol maps to was defined in
+     \param sym the symbol to lookup
+     \return the captured frame, or nullptr if sym was defined at global scope
+     */
+    std::shared_ptr<const Frame> get_closure(const Atom &sym) const;
+    
+    /*! Get the parameter names of the lambda the argument symbol maps to
+     \param sym the symbol to lookup
+     \return the parameter names, or nullptr if sym is not a lambda
+     */
+    std::shared_ptr<const std::vector<Atom>> get_parameters(const Atom &sym) const;
+    
+    /*! Classify the procedure the argument symbol maps to by what calling it
+     may do, from the bodies of it and the lambdas it calls as they are
+     currently defined. Built-in procedures are Pure. A lambda containing a
+     define is WritesGlobals, since define binds in the global mapping. One
+     that looks up a symbol other than its parameters and the procedures it
+     calls, e.g. pi, is ReadsGlobals.
+     \param sym the symbol to lookup
+     \return the classification, WritesGlobals if sym is not a procedure
+     */
+    Purity get_purity(const Atom &sym) const;
+    
+    /*! Enable memoization of calls to Pure lambdas (see get_purity), or
+     disable it. Disabled by default.
+     \param capacity the maximum number of results to cache, 0 to disable
+     */
+    void set_memo_capacity(std::size_t capacity);
+    
+    /*! Get the cache of results of calls to Pure lambdas. It is cleared when
+     a procedure is redefined or the environment reset.
+     \return the cache, or nullptr if memoization is disabled
+     */
+    MemoCache * get_memo() const;
+    
+    /*! Get the frame of the lambda call the tree walker is evaluating.
+     \return the current frame, or nullptr at global scope
+     */
+    std::shared_ptr<const Frame> get_frame() const;
+    
+    /*! Set the frame of the lambda call the tree walker is evaluating.
+     \param frame the new current frame, nullptr for global scope
+     */
+    void set_frame(std::shared_ptr<const Frame> frame);
+    
+    /*! Get the number of nested lambda calls the tree walker is evaluating.
+     \return the depth, 0 at global scope
+     */
+    std::size_t get_depth() const noexcept;
+    
+    /*! Set the number of nested lambda calls the tree walker is evaluating.
+     \param depth the new depth
+     */
+    void set_depth(std::size_t depth) noexcept;
+    
+    /*! Get the arena the temporaries of the current evaluation, such as the
+     frames of the tree walker, are allocated from. It is reset by the
+     Interpreter when an evaluation ends.
+     \return the arena
+     */
+    Arena & get_arena();
     
     /*! Reset the environment to its default state. */
     void reset();
     
+    /*! Get the symbols defined since the environment was reset, as
+     expressions or lambdas, in order of name. Built-in definitions are
+     not included, unless a program declared redefining them.
+     \return the defined symbols
+     */
+    std::vector<Atom> definitions() const;
+    
 private:
     
     // Environment is a mapping from symbols to expressions or procedures
     enum EnvResultType { ExpressionType, ProcedureType };
     
+    // what the body of a lambda does, as far as can be told without running it
+    struct Effects {
+        bool defines; // the body contains a define
+        std::vector<SymbolId> references; // the free symbols the body looks up or calls
+    };
+    
     struct EnvResult {
         EnvResultType type;
         Expression exp; // used when type is ExpressionType
         Procedure proc; // used when type is ProcedureType
+        std::shared_ptr<const Chunk> code; // compiled body when exp is a lambda
+        std::shared_ptr<const Frame> closure; // defining frame when exp is a lambda
+        std::shared_ptr<const std::vector<Atom>> parameters; // parameter names when exp is a lambda
+        std::shared_ptr<const Effects> effects; // summary of the body when exp is a lambda
+        bool builtin = false; // added by reset and not since declared defined
         
         // constructors for use in container emplace
         EnvResult(){};
-        EnvResult(EnvResultType t, Expression e) : type(t), exp(e){};
+        EnvResult(EnvResultType t, Expression e) : type(t), exp(std::move(e)){};
+        EnvResult(EnvResultType t, Expression e, std::shared_ptr<const Chunk> c, std::shared_ptr<const Frame> f) :
+        type(t), exp(std::move(e)), code(std::move(c)), closure(std::move(f)){};
         EnvResult(EnvResultType t, Procedure p) : type(t), proc(p){};
     };
     
-    // the environment map
-    std::map<std::string, EnvResult> envmap;
+    // the environment map, keyed by interned symbol id. Shared with copies
+    // of the environment until either changes it.
+    std::shared_ptr<SymbolMap<EnvResult>> envmap;
+    
+    // envmap, copied first if it is shared, to be changed
+    SymbolMap<EnvResult> & modify();
+    
+    // the entries of the default environment, built once
+    static const std::shared_ptr<SymbolMap<EnvResult>> & defaults();
+    
+    // identifies the state of envmap, changed with it. Numbers are unique to
+    // the process, so a copy shares one with its original until either
+    // changes, invalidating the cached results of get_purity and get_builtin.
+    std::size_t generation;
+    
+    // the results of get_purity, valid while purities_checked is generation.
+    // Not kept in envmap, which may be shared by environments in other threads.
+    mutable SymbolMap<Purity> purities;
+    mutable std::size_t purities_checked;
+    
+    // the purity of lambda id, excluding the lambdas in visiting, which it adds to
+    Purity resolve(SymbolId id, std::vector<SymbolId> & visiting) const;
+    
+    // the results of calls to Pure lambdas, null when memoization is disabled
+    std::unique_ptr<MemoCache> memo;
+    
+    // remove the definition of sym, if any, before it is redefined
+    void forget(SymbolId sym);
+    
+    // the frame of the lambda call the tree walker is evaluating
+    std::shared_ptr<const Frame> frame;
+    
+    // the number of nested lambda calls the tree walker is evaluating
+    std::size_t depth;
+    
+    // the temporaries of the current evaluation. Declared last, so it is
+    // destroyed after the frame above.
+    Arena arena;
 };
 
 #endif
@@ -1,9 +1,11 @@
 #include "catch.hpp"
 
 #include "environment.hpp"
+#include "parse.hpp"
 #include "semantic_error.hpp"
 
 #include <cmath>
+#include <sstream>
 
 TEST_CASE( "Test default constructor", "[environment]" ) {
     
@@ -50,7 +52,7 @@ TEST_CASE( "Test add expression", "[environment]" ) {
     REQUIRE(env.is_exp(Atom("hi")));
     REQUIRE(env.get_exp(Atom("hi")) == b);
     
-    REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), b), SemanticError);
+    REQUIRE_THROWS_AS(env.add_exp(Atom(1.0), b), const SemanticError &);
 }
 
 TEST_CASE( "Test get built-in procedure", "[environment]" ) {
@@ -95,7 +97,140 @@ TEST_CASE( "Test semeantic errors", "[environment]" ) {
     {
         Expression exp(Atom("begin"));
         
-        REQUIRE_THROWS_AS(exp.eval(env), SemanticError);
+        REQUIRE_THROWS_AS(exp.eval(env), const SemanticError &);
     }
 }
 
+
+TEST_CASE( "Test closures are copied out of the arena", "[environment]" ) {
+    
+    Environment env;
+    
+    std::shared_ptr<Frame> frame = std::allocate_shared<Frame>(ArenaAllocator<Frame>(env.get_arena()));
+    frame->slots.push_back(Expression(1.));
+    frame->names = std::make_shared<std::vector<Atom>>(1, Atom("x"));
+    REQUIRE(env.get_arena().owns(frame.get()));
+    
+    Expression lambda(Atom("lambda"));
+    Expression parameters(Atom("list"));
+    parameters.append(Atom("y"));
+    lambda.append(parameters);
+    lambda.append(Atom("x"));
+    
+    env.add_proc(Atom("f"), lambda, nullptr, frame);
+    frame.reset();
+    
+    std::shared_ptr<const Frame> closure = env.get_closure(Atom("f"));
+    REQUIRE(closure);
+    REQUIRE(!env.get_arena().owns(closure.get()));
+    REQUIRE(closure->slots.size() == 1);
+    REQUIRE(closure->slots[0] == Expression(1.));
+    REQUIRE(env.get_arena().live() == 0);
+    
+    REQUIRE(*env.get_parameters(Atom("f")) == std::vector<Atom>(1, Atom("y")));
+    REQUIRE(!env.get_parameters(Atom("+")));
+}
+
+TEST_CASE( "Test purity of procedures", "[environment]" ) {
+    
+    Environment env;
+    
+    std::istringstream iss("(begin "
+                           "(define sq (lambda (x) (* x x))) "
+                           "(define sumsq (lambda (x y) (+ (sq x) (sq y)))) "
+                           "(define count (lambda (n) (if (< n 1) 0 (count (- n 1))))) "
+                           "(define area (lambda (r) (* pi (sq r)))) "
+                           "(define later (lambda (x) (undefined x))) "
+                           "(define writes (lambda (x) (begin (define y x) y))) "
+                           "(define callsWrites (lambda (x) (sq (writes x)))) "
+                           "(define maps (lambda (x) (map writes (list x)))) "
+                           "(define outer (lambda (a) (define inner (lambda (b) (+ a b))))) "
+                           "(outer 1))");
+    Expression program = parse(tokenize(iss));
+    program.eval(env);
+    
+    REQUIRE(env.get_purity(Atom("+")) == Environment::Pure);
+    REQUIRE(env.get_purity(Atom("sq")) == Environment::Pure);
+    REQUIRE(env.get_purity(Atom("sumsq")) == Environment::Pure);
+    REQUIRE(env.get_purity(Atom("count")) == Environment::Pure);
+    REQUIRE(env.get_purity(Atom("area")) == Environment::ReadsGlobals);
+    REQUIRE(env.get_purity(Atom("later")) == Environment::ReadsGlobals);
+    REQUIRE(env.get_purity(Atom("writes")) == Environment::WritesGlobals);
+    REQUIRE(env.get_purity(Atom("callsWrites")) == Environment::WritesGlobals);
+    REQUIRE(env.get_purity(Atom("maps")) == Environment::WritesGlobals);
+    REQUIRE(env.get_purity(Atom("outer")) == Environment::WritesGlobals);
+    
+    // the parameter of the enclosing call is bound in the closure
+    REQUIRE(env.get_purity(Atom("inner")) == Environment::Pure);
+    
+    REQUIRE(env.get_purity(Atom("pi")) == Environment::WritesGlobals);
+    REQUIRE(env.get_purity(Atom("nothing")) == Environment::WritesGlobals);
+    
+    // redefining a procedure changes the purity of its callers
+    std::istringstream redefine("(define sq (lambda (x) (begin (define z x) (* x x))))");
+    parse(tokenize(redefine)).eval(env);
+    REQUIRE(env.get_purity(Atom("sumsq")) == Environment::WritesGlobals);
+}
+
+TEST_CASE( "Test inline caches of built-in procedures", "[environment]" ) {
+    
+    Environment env;
+    CallCache cache;
+    
+    std::vector<Expression> args = {Expression(1.), Expression(2.)};
+    
+    Procedure add = env.get_builtin(Atom("+"), cache);
+    REQUIRE(add == env.get_proc(Atom("+")));
+    REQUIRE(add(args) == Expression(3.));
+    
+    // a hit, also for a copy of the environment in the same state
+    REQUIRE(env.get_builtin(Atom("+"), cache) == add);
+    Environment copy(env);
+    REQUIRE(copy.get_builtin(Atom("+"), cache) == add);
+    
+    // the entry is for one symbol
+    REQUIRE(env.get_builtin(Atom("*"), cache) == env.get_proc(Atom("*")));
+    REQUIRE(env.get_builtin(Atom("pi"), cache) == nullptr);
+    REQUIRE(env.get_builtin(Atom("nothing"), cache) == nullptr);
+    REQUIRE(env.get_builtin(Atom("+"), cache) == add);
+    
+    // redefining the symbol invalidates the entry
+    std::istringstream iss("(lambda (x y) (- x y))");
+    Expression lambda = parse(tokenize(iss)).eval(env);
+    env.add_proc(Atom("+"), lambda);
+    REQUIRE(env.get_builtin(Atom("+"), cache) == nullptr);
+    REQUIRE(env.is_lambda(Atom("+")));
+    
+    // without affecting the copy
+    REQUIRE(copy.get_builtin(Atom("+"), cache) == add);
+}
+
+TEST_CASE( "Test copies share definitions until changed", "[environment]" ) {
+    
+    Environment env;
+    env.add_exp(Atom("a"), Expression(1.));
+    
+    Environment snapshot(env);
+    REQUIRE(snapshot.get_exp(Atom("a")) == Expression(1.));
+    
+    // changes to either are not seen by the other
+    env.add_exp(Atom("a"), Expression(2.));
+    env.add_exp(Atom("b"), Expression(3.));
+    snapshot.add_exp(Atom("c"), Expression(4.));
+    REQUIRE(env.get_exp(Atom("a")) == Expression(2.));
+    REQUIRE(snapshot.get_exp(Atom("a")) == Expression(1.));
+    REQUIRE(!snapshot.is_known(Atom("b")));
+    REQUIRE(!env.is_known(Atom("c")));
+    
+    Environment base(snapshot);
+    env.restore(base);
+    REQUIRE(env.get_exp(Atom("a")) == Expression(1.));
+    REQUIRE(env.get_exp(Atom("c")) == Expression(4.));
+    REQUIRE(!env.is_known(Atom("b")));
+    
+    // reset does not affect the copies either
+    env.reset();
+    REQUIRE(!env.is_known(Atom("a")));
+    REQUIRE(base.is_known(Atom("a")));
+    REQUIRE(env.is_proc(Atom("+")));
+}
@@ -1,45 +1,176 @@
 #include "expression.hpp"
 
+#include <atomic>
 #include <sstream>
 #include <list>
+#include <mutex>
+#include <utility>
 
 #include "environment.hpp"
+#include "parallel.hpp"
 #include "semantic_error.hpp"
 
-Expression::Expression(){}
+// the elements of a tail, either Expressions or packed numbers. Evaluation,
+// the plot built-ins and printing read packed numbers by index through
+// tailAt. Iterating with tailConstBegin, which yields references, expands
+// them into Expressions the first time, which may happen concurrently in
+// threads sharing the tail. The expansion costs an Expression per number
+// and lasts as long as the tail: the numbers are kept, as other threads may
+// be reading them.
+struct Expression::Tail {
+    
+    // the elements, or the expansion of the packed numbers
+    mutable std::vector<Expression> items;
+    
+    // the elements of a packed tail
+    std::vector<double> numbers;
+    
+    bool packed;
+    
+    mutable std::once_flag expanded;
+    
+    // the hash of all elements, 0 until computed. Reset whenever the tail is
+    // modified, which happens only while it is not shared.
+    mutable std::atomic<std::size_t> hash;
+    
+    // the inline cache of the procedure called, when the tail is that of a call
+    mutable CallCache calls;
+    
+    explicit Tail(bool p): packed(p), hash(0){}
+    
+    // the elements as Expressions, expanding packed numbers
+    const std::vector<Expression> & elements() const{
+        
+        if(packed){
+            std::call_once(expanded, [this](){
+                items.reserve(numbers.size());
+                for(double number : numbers){
+                    items.emplace_back(Atom(number));
+                }
+            });
+        }
+        
+        return items;
+    }
+};
+
+Expression::Expression(): m_first(0){}
 
-Expression::Expression(const Atom & a){
+Expression::Expression(const Atom & a): m_head(a), m_first(0){}
+
+Expression::Expression(std::vector<double> numbers): m_head(Atom("list")), m_first(0){
     
-    m_head = a;
+    if(!numbers.empty()){
+        m_tail = std::make_shared<Tail>(true);
+        m_tail->numbers = std::move(numbers);
+    }
 }
 
-// recursive copy
-Expression::Expression(const Expression & a){
+// shares the tail, see unshare
+Expression::Expression(const Expression & a):
+    m_head(a.m_head), m_tail(a.m_tail), m_first(a.m_first), m_properties(a.m_properties){}
+
+Expression::Expression(Expression && a) noexcept:
+    m_head(std::move(a.m_head)), m_tail(std::move(a.m_tail)), m_first(a.m_first), m_properties(std::move(a.m_properties)){}
+
+Expression & Expression::operator=(const Expression & a){
     
-    m_head = a.m_head;
-    for(auto e : a.m_tail){
-        m_tail.push_back(e);
+    // prevent self-assignment. Copying first keeps this safe when a is
+    // part of this expression's tail
+    if(this != &a){
+        *this = Expression(a);
     }
     
-    properties = a.properties;
+    return *this;
 }
 
-Expression & Expression::operator=(const Expression & a){
+Expression & Expression::operator=(Expression && a) noexcept{
     
-    // prevent self-assignment
+    // a may be part of this expression's tail, so take it over before
+    // releasing the old tail
     if(this != &a){
-        m_head = a.m_head;
-        m_tail.clear();
-        for(auto e : a.m_tail){
-            m_tail.push_back(e);
-        }
+        Atom head = std::move(a.m_head);
+        std::shared_ptr<Tail> tail = std::move(a.m_tail);
+        std::size_t first = a.m_first;
+        std::shared_ptr<PropertyList> props = std::move(a.m_properties);
         
-        properties = a.properties;
+        m_head = std::move(head);
+        m_tail.swap(tail);
+        m_first = first;
+        m_properties.swap(props);
     }
     
     return *this;
 }
 
+std::vector<Expression> & Expression::unshare(){
+    
+    if(!m_tail){
+        m_tail = std::make_shared<Tail>(false);
+    }
+    else if(m_tail->packed){
+        // unpack, without expanding the numbers in the shared tail
+        std::shared_ptr<Tail> copy = std::make_shared<Tail>(false);
+        copy->items.reserve(m_tail->numbers.size() - m_first);
+        for(auto it = m_tail->numbers.cbegin() + m_first; it != m_tail->numbers.cend(); ++it){
+            copy->items.emplace_back(Atom(*it));
+        }
+        m_tail = std::move(copy);
+        m_first = 0;
+    }
+    else if(m_tail.use_count() > 1){
+        // copy only the children, which themselves stay shared
+        std::shared_ptr<Tail> copy = std::make_shared<Tail>(false);
+        copy->items.assign(m_tail->items.cbegin() + m_first, m_tail->items.cend());
+        m_tail = std::move(copy);
+        m_first = 0;
+    }
+    else if(m_first > 0){
+        m_tail->items.erase(m_tail->items.begin(), m_tail->items.begin() + m_first);
+        m_first = 0;
+    }
+    
+    // the caller may modify the elements
+    m_tail->hash = 0;
+    
+    return m_tail->items;
+}
+
+bool Expression::pack(double value){
+    
+    if(!m_head.isList()){
+        return false;
+    }
+    
+    if(!m_tail){
+        m_tail = std::make_shared<Tail>(true);
+        m_first = 0;
+    }
+    else if(!m_tail->packed || !m_tail->items.empty()){
+        // not packed, or already expanded and so no longer appendable
+        return false;
+    }
+    else if(m_tail.use_count() > 1){
+        std::shared_ptr<Tail> copy = std::make_shared<Tail>(true);
+        copy->numbers.reserve(m_tail->numbers.size() - m_first + 1);
+        copy->numbers.assign(m_tail->numbers.cbegin() + m_first, m_tail->numbers.cend());
+        m_tail = std::move(copy);
+        m_first = 0;
+    }
+    else if(m_first > 0){
+        m_tail->numbers.erase(m_tail->numbers.begin(), m_tail->numbers.begin() + m_first);
+        m_first = 0;
+    }
+    
+    m_tail->numbers.push_back(value);
+    m_tail->hash = 0;
+    return true;
+}
+
+const Expression & Expression::child(std::size_t i) const{
+    return m_tail->elements()[m_first + i];
+}
+
 
 Atom & Expression::head(){
     return m_head;
@@ -77,40 +208,28 @@ bool Expression::isHeadNone() const noexcept{
     return m_head.isNone();
 }
 
+// the interned key naming the kind of a graphic object
+SymbolId object_name_key(){
+    static const SymbolId key = SymbolTable::instance().intern("\"object-name\"");
+    return key;
+}
+
 bool Expression::isHeadPoint() const noexcept{
-    auto result = properties.find("\"object-name\"");
+    const Expression * name = find_property(object_name_key());
     
-    if (result == properties.end()){
-        return false;
-    } else if (result->second.head().asSymbol() == "\"point\""){
-        return true;
-    } else {
-        return false;
-    }
+    return (name != nullptr) && (name->head().asSymbol() == "\"point\"");
 }
 
 bool Expression::isHeadLine() const noexcept{
-    auto result = properties.find("\"object-name\"");
+    const Expression * name = find_property(object_name_key());
     
-    if (result == properties.end()){
-        return false;
-    } else if (result->second.head().asSymbol() == "\"line\""){
-        return true;
-    } else {
-        return false;
-    }
+    return (name != nullptr) && (name->head().asSymbol() == "\"line\"");
 }
 
 bool Expression::isHeadText() const noexcept{
-    auto result = properties.find("\"object-name\"");
+    const Expression * name = find_property(object_name_key());
     
-    if (result == properties.end()){
-        return false;
-    } else if (result->second.head().asSymbol() == "\"text\""){
-        return true;
-    } else {
-        return false;
-    }
+    return (name != nullptr) && (name->head().asSymbol() == "\"text\"");
 }
 
 void Expression::setHead(const Atom & a){
@@ -118,37 +237,91 @@ void Expression::setHead(const Atom & a){
 }
 
 void Expression::append(const Atom & a){
-    m_tail.emplace_back(a);
+    if(!a.isNumber() || !pack(a.asNumber())){
+        unshare().emplace_back(a);
+    }
 }
 
 void Expression::append(const Expression & a){
-    m_tail.emplace_back(a);
+    if(!a.isHeadNumber() || a.tailSize() != 0 || a.m_properties || !pack(a.m_head.asNumber())){
+        unshare().emplace_back(a);
+    }
+}
+
+void Expression::append(Expression && a){
+    if(!a.isHeadNumber() || a.tailSize() != 0 || a.m_properties || !pack(a.m_head.asNumber())){
+        unshare().emplace_back(std::move(a));
+    }
 }
 
 int Expression::tailSize() const noexcept {
-    return m_tail.size();
+    if(!m_tail){
+        return 0;
+    }
+    
+    return (m_tail->packed ? m_tail->numbers.size() : m_tail->items.size()) - m_first;
+}
+
+Expression Expression::rest() const{
+    
+    Expression result(m_head);
+    
+    if(tailSize() > 1){
+        result.m_tail = m_tail;
+        result.m_first = m_first + 1;
+    }
+    
+    return result;
+}
+
+const Expression * Expression::find_property(SymbolId key) const noexcept{
+    
+    if(m_properties){
+        for(const auto & property : *m_properties){
+            if(property.first == key){
+                return &property.second;
+            }
+        }
+    }
+    
+    return nullptr;
 }
 
 void Expression::add_property(const Expression & key, const Expression & value) {
-    // Check if key already exists
-    auto result = properties.find(key.head().asSymbol());
     
-    if (result != properties.end()){
-        properties.erase(key.head().asSymbol());
-        properties.emplace(key.head().asSymbol(), value);
-    } else {
-        properties.emplace(key.head().asSymbol(), value);
+    SymbolId id = SymbolTable::instance().intern(key.head().asSymbol());
+    
+    // copy the properties first if they are shared, as with the tail
+    if(!m_properties){
+        m_properties = std::make_shared<PropertyList>();
+    }
+    else if(m_properties.use_count() > 1){
+        m_properties = std::make_shared<PropertyList>(*m_properties);
     }
     
+    // Check if key already exists
+    for(auto & property : *m_properties){
+        if(property.first == id){
+            property.second = value;
+            return;
+        }
+    }
     
+    m_properties->emplace_back(id, value);
 }
 
-Expression Expression::get_property(const Expression & key){
+Expression Expression::get_property(const Expression & key) const{
     
-    auto result = properties.find(key.head().asSymbol());
+    // a key never interned names no property, and is not interned by asking
+    SymbolId id;
+    if(!SymbolTable::instance().find(key.head().asSymbol(), id)){
+        return Expression();
+    }
     
-    if (result != properties.end()){
-        return result->second;
+    const Expression * result = find_property(id);
+    
+    if (result != nullptr){
+        return *result;
     } else {
         return Expression();
     }
@@ -158,22 +331,179 @@ Expression Expression::get_property(const Expression & key){
 Expression * Expression::tail(){
     Expression * ptr = nullptr;
     
-    if(m_tail.size() > 0){
-        ptr = &m_tail.back();
+    if(tailSize() > 0){
+        ptr = &unshare().back();
     }
     
     return ptr;
 }
 
+const Expression * Expression::tail() const{
+    const Expression * ptr = nullptr;
+    
+    if(tailSize() > 0){
+        ptr = &m_tail->elements().back();
+    }
+    
+    return ptr;
+}
+
+Expression Expression::tailAt(std::size_t index) const{
+    
+    if(m_tail->packed){
+        return Expression(Atom(m_tail->numbers[m_first + index]));
+    }
+    
+    return m_tail->items[m_first + index];
+}
+
+const double * Expression::tailNumbers() const noexcept{
+    
+    if(m_tail && m_tail->packed){
+        return m_tail->numbers.data() + m_first;
+    }
+    
+    return nullptr;
+}
+
+// the tail of every expression without children
+const std::vector<Expression> & empty_tail(){
+    static const std::vector<Expression> empty;
+    return empty;
+}
+
 Expression::ConstIteratorType Expression::tailConstBegin() const noexcept{
-    return m_tail.cbegin();
+    return m_tail ? m_tail->elements().cbegin() + m_first : empty_tail().cbegin();
 }
 
 Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
-    return m_tail.cend();
+    return m_tail ? m_tail->elements().cend() : empty_tail().cend();
 }
 
-Expression apply(const Atom & op, const std::vector<Expression> & args, Environment & env){
+// look up sym among the parameters of the lambda calls in scope
+bool lookup_frame(const Atom & sym, const Environment & env, Expression & result){
+    for(std::shared_ptr<const Frame> f = env.get_frame(); f; f = f->parent){
+        for(std::size_t i = 0; i < f->names->size(); ++i){
+            if((*f->names)[i] == sym){
+                result = f->slots[i];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// makes a frame current for the duration of a lambda call
+class FrameGuard {
+public:
+    FrameGuard(Environment & e, std::shared_ptr<const Frame> f): env(e), saved(e.get_frame()){
+        env.set_frame(f);
+    }
+    ~FrameGuard(){
+        env.set_frame(saved);
+    }
+private:
+    Environment & env;
+    std::shared_ptr<const Frame> saved;
+};
+
+// counts a lambda call that is not a tail call for the duration of its
+// evaluation, the first time enter is called. Tail calls replace the call
+// being evaluated, as in the virtual machine, so they are not counted.
+class DepthGuard {
+public:
+    DepthGuard(Environment & e): env(e), entered(false){}
+    ~DepthGuard(){
+        if(entered){
+            env.set_depth(env.get_depth() - 1);
+        }
+    }
+    void enter(){
+        if(entered){
+            return;
+        }
+        if(env.get_depth() >= MAX_CALL_DEPTH){
+            throw SemanticError("Error during evaluation: maximum call depth exceeded");
+        }
+        env.set_depth(env.get_depth() + 1);
+        entered = true;
+    }
+private:
+    Environment & env;
+    bool entered;
+};
+
+// finishes the memoized calls begun during an evaluation (see MemoCache) with
+// its result, or abandons them if it fails
+class MemoCalls {
+public:
+    MemoCalls(Environment & env): memo(env.get_memo()), mark(memo != nullptr ? memo->pending() : 0){}
+    ~MemoCalls(){
+        if(memo != nullptr){
+            memo->abandon_calls(mark);
+        }
+    }
+    Expression finish(Expression result){
+        if(memo != nullptr){
+            memo->finish_calls(mark, result);
+        }
+        return result;
+    }
+private:
+    MemoCache * memo;
+    std::size_t mark;
+};
+
+// look up the result of calling lambda op with values if it is Pure and
+// memoization is enabled, returns true if found. Otherwise the call is begun,
+// to be finished by the evaluation it is in tail position of.
+bool recall(const Atom & op, const std::vector<Expression> & values, Environment & env, Expression & result){
+    
+    MemoCache * memo = env.get_memo();
+    if(memo == nullptr || env.get_purity(op) != Environment::Pure){
+        return false;
+    }
+    
+    MemoCache::Key key(op.asSymbolId(), values);
+    if(memo->find(key, result)){
+        return true;
+    }
+    
+    memo->begin_call(std::move(key));
+    return false;
+}
+
+// bind the arguments of a call to the lambda op in a new frame and make it
+// current, returns the body to evaluate next. The values are moved into the
+// frame. The lambda is copied into lambda, which must outlive the evaluation
+// of the body.
+const Expression * enter_lambda(const Atom & op, std::vector<Expression> & values, Environment & env, Expression & lambda){
+    
+    std::shared_ptr<const std::vector<Atom>> identifiers = env.get_parameters(op);
+    
+    if (identifiers->size() != values.size()){
+        throw SemanticError("Error: during apply: Error in call to procedure: invalid number of arguments.");
+    }
+    
+    // bind the arguments in a new frame rather than the global map. The frame
+    // is a temporary of this evaluation unless the environment captures it.
+    std::shared_ptr<const Frame> closure = env.get_closure(op);
+    if(!identifiers->empty()){
+        std::shared_ptr<Frame> frame = std::allocate_shared<Frame>(ArenaAllocator<Frame>(env.get_arena()));
+        frame->slots = std::move(values);
+        frame->names = std::move(identifiers);
+        frame->parent = std::move(closure);
+        closure = std::move(frame);
+    }
+    
+    // op may refer into the lambda being replaced, so it is not used below
+    lambda = env.get_exp(op);
+    env.set_frame(std::move(closure));
+    
+    return &*(lambda.tailConstBegin() + 1);
+}
+
+Expression apply(const Atom & op, std::vector<Expression> & args, Environment & env){
     
     // head must be a symbol
     if(!op.isSymbol()){
@@ -186,19 +516,16 @@ Expression apply(const Atom & op, const std::vector<Expression> & args, Environm
     }
     
     if (env.is_lambda(op)){
-        Expression passToApply;
-        passToApply.setHead(Atom("apply"));
-        passToApply.append(op);
-        
-        Expression expArguments;
-        expArguments.setHead(Atom("list"));
-        
-        for (auto arg: args){
-            expArguments.append(arg);
+        // evaluate the body in a nested evaluation, restoring the frame after
+        FrameGuard guard(env, env.get_frame());
+        DepthGuard depth(env);
+        MemoCalls calls(env);
+        Expression lambda;
+        if(recall(op, args, env, lambda)){
+            return lambda;
         }
-        passToApply.append(expArguments);
-        
-        return passToApply.eval(env);
+        depth.enter();
+        return calls.finish(enter_lambda(op, args, env, lambda)->eval(env));
     } else {
         // map from symbol to proc
         Procedure proc = env.get_proc(op);
@@ -208,8 +535,13 @@ Expression apply(const Atom & op, const std::vector<Expression> & args, Environm
     }
 }
 
-Expression Expression::handle_lookup(const Atom & head, const Environment & env){
-    if(head.isSymbol()){ // if symbol is in env return value
+Expression Expression::handle_lookup(const Atom & head, const Environment & env) const{
+    Expression result;
+    
+    if(head.isSymbol() && lookup_frame(head, env, result)){ // parameters shadow globals
+        return result;
+    }
+    else if(head.isSymbol()){ // if symbol is in env return value
         if(env.is_exp(head)){
             return env.get_exp(head);
         }
@@ -225,37 +557,53 @@ Expression Expression::handle_lookup(const Atom & head, const Environment & env)
     }
 }
 
-Expression Expression::handle_begin(Environment & env){
+const Expression * Expression::handle_begin(Environment & env) const{
     
-    if(m_tail.size() == 0){
+    if(tailSize() == 0){
         throw SemanticError("Error during evaluation: zero arguments to begin");
     }
     
-    // evaluate each arg from tail, return the last
-    Expression result;
-    for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-        result = it->eval(env);
+    // evaluate each arg from tail but the last, which is left to the caller
+    for(Expression::ConstIteratorType it = tailConstBegin(); it != tailConstEnd() - 1; ++it){
+        it->eval(env);
     }
     
-    return result;
+    return &*(tailConstEnd() - 1);
 }
 
+const Expression * Expression::handle_if(Environment & env) const{
+    
+    // must have three arguments
+    if(tailSize() != 3){
+        throw SemanticError("Error during evaluation: invalid number of arguments to if");
+    }
+    
+    Expression condition = child(0).eval(env);
+    
+    if(!condition.isHeadNumber()){
+        throw SemanticError("Error during evaluation: condition of if not a number");
+    }
+    
+    // any non-zero number is true, the chosen branch is left to the caller
+    return (condition.head().asNumber() != 0) ? &child(1) : &child(2);
+}
 
-Expression Expression::handle_define(Environment & env){
+
+Expression Expression::handle_define(Environment & env) const{
     
     // tail must have size 3 or error
-    if(m_tail.size() != 2){
+    if(tailSize() != 2){
         throw SemanticError("Error during evaluation: invalid number of arguments to define");
     }
     
     // tail[0] must be symbol
-    if(!m_tail[0].isHeadSymbol()){
+    if(!child(0).isHeadSymbol()){
         throw SemanticError("Error during evaluation: first argument to define not symbol");
     }
     
     // but tail[0] must not be a special-form or procedure
-    std::string s = m_tail[0].head().asSymbol();
-    if((s == "define") || (s == "begin")){
+    SymbolId s = child(0).head().asSymbolId();
+    if((s == SymbolTable::DEFINE) || (s == SymbolTable::BEGIN)){
         throw SemanticError("Error during evaluation: attempt to redefine a special-form");
     }
     
@@ -264,38 +612,43 @@ Expression Expression::handle_define(Environment & env){
     }
     
     // eval tail[1]
-    Expression result = m_tail[1].eval(env);
+    Expression result = child(1).eval(env);
     
-    if (!m_tail[1].isHeadLambda()){
+    if (!child(1).isHeadLambda()){
         if(env.is_exp(m_head)){
             throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
         }
         
         //and add to env
-        env.add_exp(m_tail[0].head(), result);
+        env.add_exp(child(0).head(), result);
     } else {
         // Procedure proc;
         /**
-        for(Expression::IteratorType it = m_tail[1].m_tail.begin(); it != m_tail[1].m_tail.end(); ++it){
+        for(Expression::ConstIteratorType it = child(1).tailConstBegin(); it != child(1).tailConstEnd(); ++it){
             proc = env.get_proc(it->head());
         }
          */
-        // proc = env.get_proc(m_tail[1].m_tail[1].head());
-        // env.add_proc(m_tail[0].head(), proc);
-        env.add_proc(m_tail[0].head(), result);
+        // proc = env.get_proc(child(1).child(1).head());
+        // env.add_proc(child(0).head(), proc);
+        env.add_proc(child(0).head(), result, nullptr, env.get_frame());
     }
     
     return result;
 }
 
-Expression Expression::handle_list(Environment & env){
+Expression Expression::handle_list(Environment & env) const{
     
     Expression result = m_head;
     
-    if(m_tail.size() == 0){
+    if(tailSize() == 0){
+        return result;
+    } else if(tailNumbers() != nullptr){
+        // numbers evaluate to themselves, so the packed tail is shared as is
+        result.m_tail = m_tail;
+        result.m_first = m_first;
         return result;
     } else {
-        for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
+        for(Expression::ConstIteratorType it = tailConstBegin(); it != tailConstEnd(); ++it){
             result.append(it->eval(env));
         }
         return result;
@@ -303,7 +656,7 @@ Expression Expression::handle_list(Environment & env){
     
 }
 
-Expression Expression::handle_lambda(){
+Expression Expression::handle_lambda() const{
     Expression result;
     Expression arguments;
     Expression expression;
@@ -312,15 +665,15 @@ Expression Expression::handle_lambda(){
     arguments.setHead(Atom("list"));
     
     // must have two arguments
-    if(m_tail.size() != 2){
+    if(tailSize() != 2){
         throw SemanticError("Error during evaluation: invalid number of arguments to lambda");
     } else {
-        arguments.append(m_tail[0].head());
-        for(Expression::IteratorType it = m_tail[0].m_tail.begin(); it != m_tail[0].m_tail.end(); ++it){
+        arguments.append(child(0).head());
+        for(Expression::ConstIteratorType it = child(0).tailConstBegin(); it != child(0).tailConstEnd(); ++it){
             arguments.append(*it);
         }
         
-        expression = m_tail[1];
+        expression = child(1);
         
     }
     
@@ -330,77 +683,53 @@ Expression Expression::handle_lambda(){
     return result;
 }
 
-Expression Expression::handle_apply(Environment & env){
-    Expression result;
-    Expression expression;
+const Expression * Expression::handle_apply(Environment & env, Expression & result, Expression & lambda) const{
     
-    if (!env.is_proc(m_tail[0].head()) || m_tail[0].m_tail.size() != 0){
+    if (!env.is_proc(child(0).head()) || child(0).tailSize() != 0){
         throw SemanticError("Error: first argument to apply not a procedure");
     }
     
-    if (!m_tail[1].isHeadList()){
+    if (!child(1).isHeadList()){
         throw SemanticError("Error: second argument to apply not a list");
     }
     
     // must have two arguments
-    if(m_tail.size() != 2){
+    if(tailSize() != 2){
         throw SemanticError("Error during evaluation: invalid number of arguments to apply");
-    } else {
-        if (env.is_lambda(m_tail[0].head())){
-            Expression exp = env.get_exp(m_tail[0].head());
-            
-            std::vector<Atom> identifiers;
-            std::vector<Expression> values;
-            std::vector<Expression> results;
-            
-            for(Expression::IteratorType it = exp.m_tail[0].m_tail.begin(); it != exp.m_tail[0].m_tail.end(); ++it){
-                if (it->isHeadSymbol()){
-                    identifiers.push_back(it->m_head.asSymbol());
-                }
-            }
-            
-            for(Expression::IteratorType it = m_tail[1].m_tail.begin(); it != m_tail[1].m_tail.end(); ++it){
-                values.push_back(it->eval(env));
-            }
-            
-            if (identifiers.size() == values.size()){
-                for (size_t i = 0; i < identifiers.size(); i++){
-                    env.add_exp(identifiers.at(i), values.at(i));
-                }
-            } else {
-                throw SemanticError("Error: during apply: Error in call to procedure: invalid number of arguments.");
-            }
-            
-            result = exp.m_tail[1].eval(env);
-        } else {
-            // Procedures other than lambda
-            std::vector<Expression> results;
-            for(Expression::IteratorType it = m_tail[1].m_tail.begin(); it != m_tail[1].m_tail.end(); ++it){
-                // expression.append(*it);
-                results.push_back(it->eval(env));
-            }
-            
-            result = apply(m_tail[0].head(), results, env);
-        }
+    }
     
+    std::vector<Expression> values;
+    values.reserve(child(1).tailSize());
+    for(std::size_t i = 0; i < static_cast<std::size_t>(child(1).tailSize()); ++i){
+        values.push_back(child(1).tailAt(i).eval(env));
     }
     
-    return result;
+    if (env.is_lambda(child(0).head())){
+        if(recall(child(0).head(), values, env, result)){
+            return nullptr;
+        }
+        // the body is left to the caller
+        return enter_lambda(child(0).head(), values, env, lambda);
+    } else {
+        // Procedures other than lambda
+        result = apply(child(0).head(), values, env);
+        return nullptr;
+    }
 }
 
-Expression Expression::handle_map(Environment & env){
+Expression Expression::handle_map(Environment & env) const{
     Expression results;
     Expression currentResult;
     bool secondArgRange = false;
     
     results.setHead(Atom("list"));
     
-    if (!env.is_proc(m_tail[0].head()) || m_tail[0].m_tail.size() != 0){
+    if (!env.is_proc(child(0).head()) || child(0).tailSize() != 0){
         throw SemanticError("Error: first argument to map not a procedure");
     }
     
-    if (!m_tail[1].isHeadList()){
-        if (m_tail[1].isHeadSymbol() && m_tail[1].head().asSymbol() == "range"){
+    if (!child(1).isHeadList()){
+        if (child(1).head().asSymbolId() == SymbolTable::RANGE){
             secondArgRange = true;
         } else {
             throw SemanticError("Error: second argument to map not a list");
@@ -408,46 +737,40 @@ Expression Expression::handle_map(Environment & env){
     }
     
     // must have two arguments
-    if(m_tail.size() != 2){
+    if(tailSize() != 2){
         throw SemanticError("Error during evaluation: invalid number of arguments to map");
     }
     
+    // the procedure is called on each element directly rather than through
+    // an apply expression built for it
+    const Atom & op = child(0).head();
+    std::vector<Expression> values;
+    
     if (!secondArgRange){
         
-        for(Expression::IteratorType it = m_tail[1].m_tail.begin(); it != m_tail[1].m_tail.end(); ++it){
-            
-            Expression passToApply;
-            passToApply.setHead(Atom("apply"));
-            passToApply.append(m_tail[0]);
-            passToApply.append((Atom("list")));
-            passToApply.m_tail[1].append(*it);
-            
-            results.append(passToApply.eval(env));
+        for(std::size_t i = 0; i < static_cast<std::size_t>(child(1).tailSize()); ++i){
+            values.clear();
+            values.push_back(child(1).tailAt(i).eval(env));
+            results.append(apply(op, values, env));
         }
         
     } else {
         
         Expression passRangeToApply;
         
-        for(Expression::IteratorType it = m_tail[1].m_tail.begin(); it != m_tail[1].m_tail.end(); ++it){
+        for(std::size_t i = 0; i < static_cast<std::size_t>(child(1).tailSize()); ++i){
             
             passRangeToApply.setHead(Atom("range"));
-            passRangeToApply.append(*it);
+            passRangeToApply.append(child(1).tailAt(i));
             
         }
         
-        Expression rangeResult;
-        rangeResult.append(passRangeToApply.eval(env));
+        Expression rangeResult = passRangeToApply.eval(env);
         
-        for(Expression::IteratorType it = rangeResult.m_tail[0].m_tail.begin(); it != rangeResult.m_tail[0].m_tail.end(); ++it){
-            
-            Expression passToApply;
-            passToApply.setHead(Atom("apply"));
-            passToApply.append(m_tail[0]);
-            passToApply.append((Atom("list")));
-            passToApply.m_tail[1].append(*it);
-            
-            results.append(passToApply.eval(env));
+        for(std::size_t i = 0; i < static_cast<std::size_t>(rangeResult.tailSize()); ++i){
+            values.clear();
+            values.push_back(rangeResult.tailAt(i));
+            results.append(apply(op, values, env));
         }
         
     }
@@ -455,57 +778,129 @@ Expression Expression::handle_map(Environment & env){
     return results;
 }
 
-// this is a simple recursive version. the iterative version is more
-// difficult with the ast data structure used (no parent pointer).
-// this limits the practical depth of our AST
-Expression Expression::eval(Environment & env){
+Expression Expression::handle_pmap(Environment & env) const{
     
-    // TODO: Deal with empty lambda
-    if(m_tail.empty() && !m_head.isList() && !m_head.isLambda() && !m_head.isUserString()){
-        return handle_lookup(m_head, env);
-    }
-    // handle begin special-form
-    else if(m_head.isSymbol() && m_head.asSymbol() == "begin"){
-        return handle_begin(env);
-    }
-    // handle define special-form
-    else if(m_head.isSymbol() && m_head.asSymbol() == "define"){
-        return handle_define(env);
-    }
-    // handle apply special-form
-    else if(m_head.isSymbol() && m_head.asSymbol() == "apply"){
-        return handle_apply(env);
+    if (tailSize() == 0 || !env.is_proc(child(0).head()) || child(0).tailSize() != 0){
+        throw SemanticError("Error: first argument to pmap not a procedure");
     }
-    // handle map special-form
-    else if(m_head.isSymbol() && m_head.asSymbol() == "map"){
-        return handle_map(env);
-    }
-    // handle lambda special-form
-    else if(m_head.isLambda()){
-        return handle_lambda();
-    }
-    // handle list special-form
-    else if(m_head.isList()){
-        return handle_list(env);
-    }
-    else if(m_head.isUserString()){
-        return *this;
+    
+    // must have two arguments
+    if(tailSize() != 2){
+        throw SemanticError("Error during evaluation: invalid number of arguments to pmap");
     }
-    // else attempt to treat as procedure
-    else{ 
-        std::vector<Expression> results;
-        for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-            if (m_head.isSymbol() && m_head.asSymbol() == "continuous-plot"){
-                results.push_back(*it);
-            } else {
-                results.push_back(it->eval(env));
+    
+    return parallel_map(child(0).head(), child(1).eval(env), env);
+}
+
+// evaluation recurses into the arguments of an expression but loops through
+// its tail position: the last expression of a begin, the chosen branch of an
+// if and the body of a called lambda replace the expression being evaluated.
+// Tail calls therefore run in constant C++ stack and, since a replaced frame
+// is released, in constant memory.
+Expression Expression::eval(Environment & env) const{
+    
+    // restores the caller's frame, which entering a lambda replaces
+    FrameGuard guard(env, env.get_frame());
+    
+    // counts the first lambda entered, the calls entered after it being tail calls
+    DepthGuard depth(env);
+    
+    // the memoized lambdas called in tail position return the result
+    MemoCalls calls(env);
+    
+    // the lambda whose body is being evaluated
+    Expression lambda;
+    
+    const Expression * exp = this;
+    
+    while(true){
+        
+        const Atom & head = exp->m_head;
+        
+        // TODO: Deal with empty lambda
+        if(exp->tailSize() == 0 && !head.isList() && !head.isLambda() && !head.isUserString()){
+            return calls.finish(handle_lookup(head, env));
+        }
+        else if(head.isUserString()){
+            return calls.finish(*exp);
+        }
+        
+        // the special-forms, list and lambda are well-known symbols, so this
+        // switch on the interned id of the head dispatches without comparing
+        // names. Any other head is a procedure call.
+        switch(head.asSymbolId()){
+            case SymbolTable::BEGIN:
+                exp = exp->handle_begin(env);
+                break;
+                
+            case SymbolTable::IF:
+                exp = exp->handle_if(env);
+                break;
+                
+            case SymbolTable::DEFINE:
+                return calls.finish(exp->handle_define(env));
+                
+            case SymbolTable::APPLY:
+            {
+                Expression result;
+                exp = exp->handle_apply(env, result, lambda);
+                if(exp == nullptr){
+                    return calls.finish(result);
+                }
+                depth.enter();
+            }
+                break;
+                
+            case SymbolTable::MAP:
+                return calls.finish(exp->handle_map(env));
+                
+            case SymbolTable::PMAP:
+                return calls.finish(exp->handle_pmap(env));
+                
+            case SymbolTable::LAMBDA:
+                return calls.finish(exp->handle_lambda());
+                
+            case SymbolTable::LIST:
+                return calls.finish(exp->handle_list(env));
+                
+            default:
+            {
+                // continuous-plot takes its function argument unevaluated
+                bool unevaluated = (head.asSymbolId() == SymbolTable::CONTINUOUS_PLOT);
+                
+                std::vector<Expression> results;
+                results.reserve(exp->tailSize());
+                for(Expression::ConstIteratorType it = exp->tailConstBegin(); it != exp->tailConstEnd(); ++it){
+                    if(unevaluated){
+                        results.push_back(*it);
+                    } else {
+                        results.push_back(it->eval(env));
+                    }
+                }
+                
+                // a built-in resolved through the inline cache of the call
+                // site is called without looking up its name
+                Procedure builtin = (exp->m_tail && exp->m_first == 0) ?
+                    env.get_builtin(head, exp->m_tail->calls) : nullptr;
+                if(builtin != nullptr){
+                    return calls.finish(builtin(results));
+                }
+                
+                if(head.isSymbol() && env.is_lambda(head)){
+                    Expression result;
+                    if(recall(head, results, env, result)){
+                        return calls.finish(result);
+                    }
+                    depth.enter();
+                    exp = enter_lambda(head, results, env, lambda);
+                } else {
+                    return calls.finish(apply(head, results, env));
+                }
             }
         }
-        return apply(m_head, results, env);
     }
 }
 
-
 std::ostream & operator<<(std::ostream & out, const Expression & exp){
     
     /// Final output handled
@@ -528,13 +923,12 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
         }
     }
     
-    for(auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e){
-        out << *e;
-        auto f = e;
-        f++;
-        if (f != exp.tailConstEnd()){
+    // indexed, so a packed tail is not expanded
+    for(std::size_t i = 0; i < static_cast<std::size_t>(exp.tailSize()); ++i){
+        if (i != 0){
             out << " ";
         }
+        out << exp.tailAt(i);
     }
     
     if (!exp.isHeadComplex()){
@@ -551,16 +945,27 @@ bool Expression::operator==(const Expression & exp) const noexcept{
     if(exp.isHeadComplex()) {
         result = (m_head.asComplex() == exp.m_head.asComplex());
     } else if(exp.isHeadList()){
-        result = (m_head.asSymbol() == exp.m_head.asSymbol());
+        result = (m_head.asSymbolId() == exp.m_head.asSymbolId());
     } else {
         result = (m_head == exp.m_head);
     }
     
-    result = result && (m_tail.size() == exp.m_tail.size());
+    result = result && (tailSize() == exp.tailSize());
     
-    if(result){
-        for(auto lefte = m_tail.begin(), righte = exp.m_tail.begin();
-            (lefte != m_tail.end()) && (righte != exp.m_tail.end());
+    // expressions sharing their tail have equal tails
+    if(result && (m_tail == exp.m_tail && m_first == exp.m_first)){
+        return true;
+    }
+    
+    // packed tails are compared without expanding them
+    if(result && (tailNumbers() != nullptr || exp.tailNumbers() != nullptr)){
+        for(std::size_t i = 0; result && i < static_cast<std::size_t>(tailSize()); ++i){
+            result = (tailAt(i) == exp.tailAt(i));
+        }
+    }
+    else if(result){
+        for(auto lefte = tailConstBegin(), righte = exp.tailConstBegin();
+            (lefte != tailConstEnd()) && (righte != exp.tailConstEnd());
             ++lefte, ++righte){
             result = result && (*lefte == *righte);
         }
@@ -569,6 +974,107 @@ bool Expression::operator==(const Expression & exp) const noexcept{
     return result;
 }
 
+bool Expression::identical(const Expression & exp) const noexcept{
+    
+    if(!m_head.identical(exp.m_head) || tailSize() != exp.tailSize()){
+        return false;
+    }
+    
+    // identical tails hash equal, and the hashes are usually cached
+    if(tail_hash() != exp.tail_hash()){
+        return false;
+    }
+    
+    if(m_properties != exp.m_properties){
+        if(!m_properties || !exp.m_properties || m_properties->size() != exp.m_properties->size()){
+            return false;
+        }
+        for(std::size_t i = 0; i < m_properties->size(); ++i){
+            if((*m_properties)[i].first != (*exp.m_properties)[i].first ||
+               !(*m_properties)[i].second.identical((*exp.m_properties)[i].second)){
+                return false;
+            }
+        }
+    }
+    
+    if(m_tail == exp.m_tail && m_first == exp.m_first){
+        return true;
+    }
+    
+    const double * numbers = tailNumbers();
+    const double * expNumbers = exp.tailNumbers();
+    
+    for(std::size_t i = 0; i < static_cast<std::size_t>(tailSize()); ++i){
+        bool same;
+        if(numbers != nullptr && expNumbers != nullptr){
+            same = (numbers[i] == expNumbers[i]);
+        }
+        else if(numbers == nullptr && expNumbers == nullptr){
+            same = child(i).identical(exp.child(i));
+        }
+        else{
+            same = tailAt(i).identical(exp.tailAt(i));
+        }
+        if(!same){
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// mix the hash h into seed
+void hash_combine(std::size_t & seed, std::size_t h) noexcept{
+    seed ^= h + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+std::size_t Expression::tail_hash() const noexcept{
+    
+    // only the hash of a whole tail is cached, not of one shared by rest
+    bool cache = m_tail && m_first == 0;
+    if(cache){
+        std::size_t cached = m_tail->hash.load(std::memory_order_relaxed);
+        if(cached != 0){
+            return cached;
+        }
+    }
+    
+    std::size_t h = 0;
+    bool packed = (tailNumbers() != nullptr);
+    
+    for(std::size_t i = 0; i < static_cast<std::size_t>(tailSize()); ++i){
+        hash_combine(h, packed ? tailAt(i).hash() : child(i).hash());
+    }
+    hash_combine(h, tailSize());
+    
+    // 0 marks a hash not computed yet
+    if(h == 0){
+        h = 1;
+    }
+    
+    // threads sharing the tail compute the same value, so a race is harmless
+    if(cache){
+        m_tail->hash.store(h, std::memory_order_relaxed);
+    }
+    
+    return h;
+}
+
+std::size_t Expression::hash() const noexcept{
+    
+    std::size_t h = m_head.hash();
+    hash_combine(h, tail_hash());
+    
+    if(m_properties){
+        for(const auto & property : *m_properties){
+            hash_combine(h, property.first);
+            hash_combine(h, property.second.hash());
+        }
+    }
+    
+    return h;
+}
+
 bool operator!=(const Expression & left, const Expression & right) noexcept{
     
     return !(left == right);
@@ -6,7 +6,8 @@
 
 #include <string>
 #include <vector>
-#include <map>
+#include <memory>
+#include <utility>
 
 #include "token.hpp"
 #include "atom.hpp"
@@ -19,6 +20,21 @@ class Environment;
  
  An expression is an atom called the head followed by a (possibly empty)
  list of expressions called the tail.
+ 
+ The tail is immutable and shared between copies of an expression, so
+ copying an expression (for example looking up a defined list) costs O(1)
+ regardless of its size. Modifying the tail of an expression through
+ append or tail() first copies it if it is shared (copy-on-write).
+ 
+ Properties are kept the same way, in a small list that is only allocated
+ once a property is added. Property keys are interned (see SymbolTable).
+ 
+ The tail of a list of plain numbers (numbers without a tail or properties)
+ is stored packed, as contiguous doubles, which takes a fraction of the
+ memory of one Expression per number. Appending anything else to it, or
+ modifying it through tail(), turns it into an ordinary tail. Iterating over
+ a packed tail creates its elements as Expressions the first time; tailAt
+ and tailNumbers access it without doing so.
  */
 class Expression {
 public:
@@ -33,12 +49,23 @@ public:
      */
     Expression(const Atom & a);
     
-    /// deep-copy construct an expression (recursive)
+    /*! Construct a list of numbers, with the tail stored packed
+     \param numbers the elements of the list
+     */
+    explicit Expression(std::vector<double> numbers);
+    
+    /// copy construct an expression, sharing the tail of a
     Expression(const Expression & a);
     
-    /// deep-copy assign an expression  (recursive)
+    /// move construct an expression, taking over the tail and properties of a
+    Expression(Expression && a) noexcept;
+    
+    /// copy assign an expression, sharing the tail of a
     Expression & operator=(const Expression & a);
     
+    /// move assign an expression, taking over the tail and properties of a
+    Expression & operator=(Expression && a) noexcept;
+    
     /// return a reference to the head Atom
     Atom & head();
     
@@ -54,18 +81,37 @@ public:
     /// append Expression to tail of the expression
     void append(const Expression & a);
     
+    /// append Expression to tail of the expression, moving from a
+    void append(Expression && a);
+    
     /// return the current size of the tail
     int tailSize() const noexcept;
     
-    /// Add a new property to an expression
+    /// Add a new property to an expression, replacing any with the same key
     void add_property(const Expression & key, const Expression & value);
     
     /// Gets property value
-    Expression get_property(const Expression & key);
+    Expression get_property(const Expression & key) const;
+    
+    /// return an expression with the same head and all but the first element
+    /// of the tail, sharing those elements with this expression
+    Expression rest() const;
     
-    /// return a pointer to the last expression in the tail, or nullptr
+    /// return a pointer to the last expression in the tail, or nullptr. The
+    /// tail is unshared first, as the pointer may be used to modify it.
     Expression * tail();
     
+    /// return a const pointer to the last expression in the tail, or nullptr
+    const Expression * tail() const;
+    
+    /// return the element of the tail at index, which must be less than
+    /// tailSize. Does not expand a packed tail.
+    Expression tailAt(std::size_t index) const;
+    
+    /// return a pointer to the tailSize numbers of a packed tail, or nullptr
+    /// if the tail is not packed
+    const double * tailNumbers() const noexcept;
+    
     /// return a const-iterator to the beginning of tail
     ConstIteratorType tailConstBegin() const noexcept;
     
@@ -102,35 +148,77 @@ public:
     /// convienience member to determine if head atom is a text
     bool isHeadText() const noexcept;
     
-    /// Evaluate expression using a post-order traversal (recursive)
-    Expression eval(Environment & env);
+    /// Evaluate expression using a post-order traversal (recursive, except
+    /// through tail positions, so tail calls run in constant stack)
+    Expression eval(Environment & env) const;
     
     /// equality comparison for two expressions (recursive)
     bool operator==(const Expression & exp) const noexcept;
     
+    /// exact comparison of head, tail and properties (recursive), numbers
+    /// compared without tolerance
+    bool identical(const Expression & exp) const noexcept;
+    
+    /// hash of head, tail and properties (recursive), equal for identical
+    /// expressions. The hash of a tail is cached with it, so hashing an
+    /// expression again, or one sharing its tail, takes constant time.
+    std::size_t hash() const noexcept;
+    
 private:
     
     // the head of the expression
     Atom m_head;
     
+    // the elements of a tail, defined in expression.cpp
+    struct Tail;
+    
     // the tail list is expressed as a vector for access efficiency
-    // and cache coherence, at the cost of wasted memory.
-    std::vector<Expression> m_tail;
+    // and cache coherence, at the cost of wasted memory. The tail is
+    // shared between copies and null when it is empty.
+    std::shared_ptr<Tail> m_tail;
+    
+    // index of the first element of the tail in m_tail, so rest can
+    // share the tail of its argument
+    std::size_t m_first;
+    
+    // the properties as (interned key, value) pairs, shared between copies
+    // and null when there are none
+    typedef std::vector<std::pair<SymbolId, Expression>> PropertyList;
+    std::shared_ptr<PropertyList> m_properties;
+    
+    // return the value of the property with the interned key, or nullptr
+    const Expression * find_property(SymbolId key) const noexcept;
+    
+    // return the tail for modification, copying it first if it is shared
+    // and unpacking it if it is packed
+    std::vector<Expression> & unshare();
+    
+    // append a number to a packed or empty tail of a list, returns false if
+    // it cannot be kept packed
+    bool pack(double value);
+    
+    // return the i-th element of the tail
+    const Expression & child(std::size_t i) const;
+    
+    // return the hash of the elements of the tail, cached in the tail
+    std::size_t tail_hash() const noexcept;
     
-    // the property map
-    std::map<std::string, Expression> properties;
+    // builds identical expressions sharing their tails and properties
+    friend class HashCons;
     
-    // convenience typedef
-    typedef std::vector<Expression>::iterator IteratorType;
+    // saves and restores expressions with their properties
+    friend class Image;
     
     // internal helper methods
-    Expression handle_lookup(const Atom & head, const Environment & env);
-    Expression handle_define(Environment & env);
-    Expression handle_begin(Environment & env);
-    Expression handle_list(Environment & env);
-    Expression handle_lambda();
-    Expression handle_apply(Environment & env);
-    Expression handle_map(Environment & env);
+    Expression handle_lookup(const Atom & head, const Environment & env) const;
+    Expression handle_define(Environment & env) const;
+    const Expression * handle_begin(Environment & env) const;
+    const Expression * handle_if(Environment & env) const;
+    Expression handle_list(Environment & env) const;
+    Expression handle_lambda() const;
+    const Expression * handle_apply(Environment & env, Expression & result, Expression & lambda) const;
+    Expression handle_map(Environment & env) const;
+    Expression handle_pmap(Environment & env) const;
 };
 
 /// Render expression to output stream
@@ -1,5 +1,7 @@
 #include "catch.hpp"
 
+#include <type_traits>
+
 #include "expression.hpp"
 
 TEST_CASE( "Test default expression", "[expression]" ) {
@@ -27,3 +29,188 @@ TEST_CASE( "Test symbol expression", "[expression]" ) {
     REQUIRE(exp.isHeadSymbol());
 }
 
+
+TEST_CASE( "Test moving an expression", "[expression]" ) {
+    
+    REQUIRE(std::is_nothrow_move_constructible<Expression>::value);
+    REQUIRE(std::is_nothrow_move_assignable<Expression>::value);
+    
+    Expression list(Atom("list"));
+    list.append(Atom(1.));
+    list.append(Atom(2.));
+    list.add_property(Expression(Atom("\"key\"")), Expression(Atom(3.)));
+    
+    Expression copy(list);
+    
+    {
+        INFO("move construct");
+        Expression moved(std::move(copy));
+        REQUIRE(moved == list);
+        REQUIRE(moved.get_property(Expression(Atom("\"key\""))) == Expression(Atom(3.)));
+    }
+    
+    {
+        INFO("move assign from part of the tail");
+        Expression nested(Atom("list"));
+        nested.append(list);
+        nested = std::move(*nested.tail());
+        REQUIRE(nested == list);
+    }
+    
+    {
+        INFO("copy assign from part of the tail");
+        Expression nested(Atom("list"));
+        nested.append(list);
+        nested = *nested.tail();
+        REQUIRE(nested == list);
+    }
+}
+
+TEST_CASE( "Test copies share the tail until modified", "[expression]" ) {
+    
+    Expression list(Atom("list"));
+    for(int i = 0; i < 4; ++i){
+        list.append(Atom(double(i)));
+    }
+    
+    {
+        INFO("copy is equal and modifying it leaves the original unchanged");
+        Expression copy(list);
+        REQUIRE(copy == list);
+        REQUIRE(&*copy.tailConstBegin() == &*list.tailConstBegin());
+        
+        copy.append(Atom(4.));
+        REQUIRE(copy.tailSize() == 5);
+        REQUIRE(list.tailSize() == 4);
+        REQUIRE(&*copy.tailConstBegin() != &*list.tailConstBegin());
+    }
+    
+    {
+        INFO("rest shares the remaining elements");
+        Expression rest = list.rest().rest();
+        REQUIRE(rest.isHeadList());
+        REQUIRE(rest.tailSize() == 2);
+        REQUIRE(*rest.tailConstBegin() == Expression(Atom(2.)));
+        REQUIRE(&*rest.tailConstBegin() == &*(list.tailConstBegin() + 2));
+        
+        rest.append(Atom(4.));
+        REQUIRE(rest.tailSize() == 3);
+        REQUIRE(*rest.tailConstBegin() == Expression(Atom(2.)));
+        REQUIRE(list.tailSize() == 4);
+    }
+    
+    {
+        INFO("rest of a single element is empty");
+        Expression single(Atom("list"));
+        single.append(Atom(1.));
+        REQUIRE(single.rest().tailSize() == 0);
+        REQUIRE(single.rest().isHeadList());
+    }
+}
+
+TEST_CASE( "Test properties", "[expression]" ) {
+    
+    Expression key(Atom("\"key\""));
+    Expression objectName(Atom("\"object-name\""));
+    
+    Expression point(Atom("list"));
+    REQUIRE(point.get_property(key) == Expression());
+    REQUIRE(!point.isHeadPoint());
+    
+    point.add_property(objectName, Expression(Atom("\"point\"")));
+    point.add_property(key, Expression(Atom(1.)));
+    REQUIRE(point.isHeadPoint());
+    REQUIRE(!point.isHeadLine());
+    REQUIRE(!point.isHeadText());
+    
+    {
+        INFO("adding a property with the same key replaces it");
+        point.add_property(key, Expression(Atom(2.)));
+        REQUIRE(point.get_property(key) == Expression(Atom(2.)));
+    }
+    
+    {
+        INFO("copies keep their own properties once one is modified");
+        Expression copy(point);
+        copy.add_property(key, Expression(Atom(3.)));
+        copy.add_property(objectName, Expression(Atom("\"line\"")));
+        REQUIRE(copy.get_property(key) == Expression(Atom(3.)));
+        REQUIRE(copy.isHeadLine());
+        REQUIRE(point.get_property(key) == Expression(Atom(2.)));
+        REQUIRE(point.isHeadPoint());
+    }
+    
+    {
+        INFO("looking up a key never added does not intern it");
+        Expression unknown(Atom(Token(Token::USERSTRING, "\"never-added-key\"")));
+        REQUIRE(point.get_property(unknown) == Expression());
+        
+        SymbolId id;
+        REQUIRE(!SymbolTable::instance().find("\"never-added-key\"", id));
+    }
+}
+
+TEST_CASE( "Test lists of numbers are packed", "[expression]" ) {
+    
+    Expression packed(std::vector<double>{1., 2., 3.});
+    REQUIRE(packed.isHeadList());
+    REQUIRE(packed.tailSize() == 3);
+    REQUIRE(packed.tailNumbers() != nullptr);
+    REQUIRE(packed.tailNumbers()[2] == 3.);
+    REQUIRE(packed.tailAt(1) == Expression(2.));
+    
+    {
+        INFO("appending numbers to a list keeps it packed");
+        Expression list(Atom("list"));
+        list.append(Atom(1.));
+        list.append(Expression(2.));
+        list.append(Expression(3.));
+        REQUIRE(list.tailNumbers() != nullptr);
+        REQUIRE(list == packed);
+    }
+    
+    {
+        INFO("rest shares the packed numbers");
+        Expression rest = packed.rest();
+        REQUIRE(rest.tailNumbers() == packed.tailNumbers() + 1);
+        REQUIRE(rest.tailAt(0) == Expression(2.));
+    }
+    
+    {
+        INFO("appending anything else unpacks a copy");
+        Expression mixed(packed);
+        mixed.append(Atom("\"text\""));
+        REQUIRE(mixed.tailNumbers() == nullptr);
+        REQUIRE(mixed.tailSize() == 4);
+        REQUIRE(*mixed.tailConstBegin() == Expression(1.));
+        REQUIRE(packed.tailNumbers() != nullptr);
+        REQUIRE(packed.tailSize() == 3);
+    }
+    
+    {
+        INFO("packed and unpacked tails compare equal");
+        Expression unpacked(packed);
+        unpacked.tail();
+        REQUIRE(unpacked.tailNumbers() == nullptr);
+        REQUIRE(unpacked == packed);
+        REQUIRE(packed == unpacked);
+    }
+    
+    {
+        INFO("iterating expands the numbers");
+        double sum = 0;
+        for(auto it = packed.tailConstBegin(); it != packed.tailConstEnd(); ++it){
+            sum += it->head().asNumber();
+        }
+        REQUIRE(sum == 6.);
+    }
+    
+    {
+        INFO("numbers with properties are not packed");
+        Expression point(Atom("list"));
+        Expression number(1.);
+        number.add_property(Expression(Atom("\"key\"")), Expression(2.));
+        point.append(number);
+        REQUIRE(point.tailNumbers() == nullptr);
+    }
+}
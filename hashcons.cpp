@@ -0,0 +1,133 @@
+#include "hashcons.hpp"
+
+// system includes
+#include <functional>
+#include <vector>
+
+HashCons::HashCons(): on(false){}
+
+HashCons & HashCons::instance(){
+
+    // initialization of a local static is thread-safe
+    static HashCons table;
+    return table;
+}
+
+bool HashCons::enabled() const noexcept{
+
+    return on;
+}
+
+void HashCons::set_enabled(bool enable){
+
+    on = enable;
+    if(!enable){
+        clear();
+    }
+}
+
+Expression HashCons::intern(const Expression & exp){
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return intern_locked(exp);
+}
+
+std::size_t HashCons::size() const{
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return expressions.size() + properties.size();
+}
+
+void HashCons::clear(){
+
+    std::lock_guard<std::mutex> lock(mutex);
+    expressions.clear();
+    properties.clear();
+}
+
+Expression HashCons::intern_locked(const Expression & exp){
+
+    // an atom has nothing to share
+    if(!exp.m_tail && !exp.m_properties){
+        return exp;
+    }
+
+    Expression result(exp);
+
+    // the elements of a packed tail are numbers, which have nothing to share
+    if(exp.m_tail && exp.tailNumbers() == nullptr){
+        std::vector<Expression> items;
+        items.reserve(exp.tailSize());
+
+        bool changed = (exp.m_first != 0);
+        for(std::size_t i = 0; i < static_cast<std::size_t>(exp.tailSize()); ++i){
+            const Expression & child = exp.child(i);
+            items.push_back(intern_locked(child));
+            changed = changed || (items.back().m_tail != child.m_tail) ||
+                (items.back().m_properties != child.m_properties);
+        }
+
+        if(changed){
+            Expression rebuilt(exp.head());
+            for(auto & item : items){
+                rebuilt.append(std::move(item));
+            }
+            result.m_tail = std::move(rebuilt.m_tail);
+            result.m_first = 0;
+        }
+    }
+
+    if(exp.m_properties){
+        Expression::PropertyList list;
+        list.reserve(exp.m_properties->size());
+        for(const auto & property : *exp.m_properties){
+            list.emplace_back(property.first, intern_locked(property.second));
+        }
+        result.m_properties = intern_properties(list);
+    }
+
+    std::size_t hash = result.hash();
+
+    auto range = expressions.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it){
+        if(it->second.identical(result)){
+            return it->second;
+        }
+    }
+
+    expressions.emplace(hash, result);
+    return result;
+}
+
+std::shared_ptr<Expression::PropertyList> HashCons::intern_properties(const Expression::PropertyList & list){
+
+    std::size_t hash = list.size();
+    for(const auto & property : list){
+        hash = hash * 31 + std::hash<SymbolId>()(property.first);
+        hash = hash * 31 + property.second.hash();
+    }
+
+    auto range = properties.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it){
+        const Expression::PropertyList & other = *it->second;
+
+        bool same = (other.size() == list.size());
+        for(std::size_t i = 0; same && i < list.size(); ++i){
+            same = (other[i].first == list[i].first) && other[i].second.identical(list[i].second);
+        }
+
+        if(same){
+            return it->second;
+        }
+    }
+
+    std::shared_ptr<Expression::PropertyList> interned = std::make_shared<Expression::PropertyList>(list);
+    properties.emplace(hash, interned);
+    return interned;
+}
+
+Expression share(const Expression & exp){
+
+    HashCons & table = HashCons::instance();
+    return table.enabled() ? table.intern(exp) : exp;
+}
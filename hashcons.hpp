@@ -0,0 +1,90 @@
+/*! \file hashcons.hpp
+ Defines the table used to store identical expressions once (hash-consing).
+ */
+#ifndef HASHCONS_HPP
+#define HASHCONS_HPP
+
+// system includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// module includes
+#include "expression.hpp"
+
+/*! \class HashCons
+ \brief A process-wide table of expressions, keyed by structural hash.
+
+ intern returns an expression identical to its argument whose tail and
+ properties are shared with those of the expressions interned before it,
+ recursively. Repeated subtrees, such as the points of a plot or the style
+ properties they all carry, are then stored once, and comparing two interned
+ expressions finds their shared tails equal in constant time.
+
+ Hash-consing is optional. While it is enabled, parse interns the program
+ and the built-in procedures building plot data intern their results. The
+ table keeps the expressions it holds alive until it is cleared, which
+ disabling it also does.
+
+ The table is locked while it is used, so it may be used from any thread.
+ */
+class HashCons {
+public:
+
+    /// return the table
+    static HashCons & instance();
+
+    HashCons(const HashCons &) = delete;
+    HashCons & operator=(const HashCons &) = delete;
+
+    /// return true if hash-consing is enabled, the default is disabled
+    bool enabled() const noexcept;
+
+    /// enable or disable hash-consing, disabling clears the table
+    void set_enabled(bool on);
+
+    /*! Return an expression identical to exp that shares its tail and
+     properties, and those of its subexpressions, with expressions interned
+     before. The result is added to the table.
+     \param exp the expression to intern
+     \return the interned expression
+     */
+    Expression intern(const Expression & exp);
+
+    /// return the number of distinct expressions and property lists held
+    std::size_t size() const;
+
+    /// release the expressions held by the table
+    void clear();
+
+private:
+
+    HashCons();
+
+    std::atomic<bool> on;
+
+    mutable std::mutex mutex;
+
+    // the interned expressions with a tail or properties, by hash
+    std::unordered_multimap<std::size_t, Expression> expressions;
+
+    // the interned property lists, by hash
+    std::unordered_multimap<std::size_t, std::shared_ptr<Expression::PropertyList>> properties;
+
+    // intern exp, with the table locked
+    Expression intern_locked(const Expression & exp);
+
+    // return the interned property list identical to list, adding it if new
+    std::shared_ptr<Expression::PropertyList> intern_properties(const Expression::PropertyList & list);
+};
+
+/*! \fn share
+ \brief intern exp if hash-consing is enabled
+
+ \param exp the expression
+ \return exp, or the interned expression identical to it
+ */
+Expression share(const Expression & exp);
+
+#endif
@@ -0,0 +1,83 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "hashcons.hpp"
+#include "interpreter.hpp"
+#include "parse.hpp"
+
+// parse program into an expression
+Expression parse_program(const std::string & program){
+
+    std::istringstream iss(program);
+    return parse(tokenize(iss));
+}
+
+TEST_CASE( "Test structural hash", "[hashcons]" ) {
+
+    Expression a = parse_program("(f (g 1 2) \"text\" (list 1 2))");
+    Expression b = parse_program("(f (g 1 2) \"text\" (list 1 2))");
+    Expression c = parse_program("(f (g 1 3) \"text\" (list 1 2))");
+
+    REQUIRE(a.hash() == b.hash());
+    REQUIRE(a.identical(b));
+    REQUIRE(!a.identical(c));
+
+    // the cached hash of a tail is discarded when it is modified
+    std::size_t before = c.hash();
+    c.append(Atom(4.));
+    REQUIRE(c.hash() != before);
+    REQUIRE(!a.identical(c));
+
+    // a tail shared by rest hashes as its elements do
+    Expression list = parse_program("(list 0 (g 1 2) \"text\")");
+    Expression expected = parse_program("(list (g 1 2) \"text\")");
+    REQUIRE(list.rest().hash() == expected.hash());
+    REQUIRE(list.rest().identical(expected));
+}
+
+TEST_CASE( "Test hash-consing shares identical subtrees", "[hashcons]" ) {
+
+    HashCons & table = HashCons::instance();
+    REQUIRE(!table.enabled());
+    REQUIRE(share(parse_program("(list 1 2)")).hash() == parse_program("(list 1 2)").hash());
+
+    table.set_enabled(true);
+
+    Expression a = parse_program("(begin (define p (list (+ 1 x) (+ 1 x))) (list (+ 1 x) \"s\"))");
+    Expression b = parse_program("(list (+ 1 x) \"s\")");
+
+    // identical subtrees are stored once, within and between expressions
+    Expression x1 = *a.tailConstBegin()->tail();
+    Expression x2 = *(a.tailConstEnd() - 1);
+    REQUIRE(x1.tailConstBegin()->tailConstBegin() == (x1.tailConstBegin() + 1)->tailConstBegin());
+    REQUIRE(x2.tailConstBegin() == b.tailConstBegin());
+
+    std::size_t size = table.size();
+    Expression again = parse_program("(list (+ 1 x) \"s\")");
+    REQUIRE(table.size() == size);
+    REQUIRE(again.tailConstBegin() == b.tailConstBegin());
+
+    table.set_enabled(false);
+    REQUIRE(table.size() == 0);
+}
+
+TEST_CASE( "Test hash-consing shares plot properties", "[hashcons]" ) {
+
+    HashCons::instance().set_enabled(true);
+
+    std::istringstream iss("(discrete-plot (list (list 0 0) (list 1 1) (list 0 0)) (list (list \"title\" \"t\")))");
+    Interpreter interp;
+    REQUIRE(interp.parseStream(iss));
+    Expression plot = interp.evaluate();
+
+    REQUIRE(plot.tailSize() == 3);
+    const Expression & first = *plot.tailConstBegin();
+    const Expression & last = *(plot.tailConstEnd() - 1);
+    REQUIRE(first == last);
+    REQUIRE(first.tailConstBegin() == last.tailConstBegin());
+    REQUIRE(first.get_property(Expression(Atom("\"object-name\""))) == Expression(Atom("\"point\"")));
+
+    HashCons::instance().set_enabled(false);
+}
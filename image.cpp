@@ -0,0 +1,284 @@
+#include "image.hpp"
+
+// system includes
+#include <algorithm>
+#include <complex>
+#include <utility>
+#include <vector>
+
+// module includes
+#include "symbol.hpp"
+
+// identifies an image, and the layout of this version of it
+static const char MAGIC[4] = {'P', 'L', 'S', 'I'};
+static const std::uint32_t FORMAT_VERSION = 1;
+
+// read back in another byte order if the image was written on another machine
+static const std::uint32_t ORDER_MARK = 0x01020304;
+
+// images nest no deeper than this, so a corrupt one can not exhaust the stack
+static const std::size_t MAX_DEPTH = 10000;
+
+// the kinds of atom heads and of definitions, as stored
+enum AtomTag : unsigned char { NoneTag, NumberTag, ComplexTag, SymbolTag, UserStringTag };
+enum EntryTag : unsigned char { ValueTag, LambdaTag };
+
+// the FNV-1a hash of text, which identifies the program an image was saved for
+static std::uint64_t fingerprint(const std::string & text){
+
+    std::uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : text){
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+template<typename T>
+static void put(std::ostream & out, T value){
+
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void put_string(std::ostream & out, const std::string & value){
+
+    put<std::uint64_t>(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+template<typename T>
+static bool get(std::istream & in, T & value){
+
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+static bool get_string(std::istream & in, std::string & value){
+
+    std::uint64_t size;
+    if(!get(in, size)){
+        return false;
+    }
+
+    // read in pieces, so a corrupt size fails at the end of the stream
+    // instead of allocating it up front
+    value.clear();
+    char buffer[4096];
+    while(size > 0){
+        std::size_t piece = (size < sizeof(buffer)) ? static_cast<std::size_t>(size) : sizeof(buffer);
+        if(!in.read(buffer, piece)){
+            return false;
+        }
+        value.append(buffer, piece);
+        size -= piece;
+    }
+    return true;
+}
+
+bool Image::save(std::ostream & out, const Environment & env, const std::string & source){
+
+    std::vector<Atom> names = env.definitions();
+
+    // a closure refers to the frames of the calls it was defined in
+    for(const Atom & name : names){
+        if(env.get_closure(name)){
+            return false;
+        }
+    }
+
+    out.write(MAGIC, sizeof(MAGIC));
+    put(out, FORMAT_VERSION);
+    put(out, ORDER_MARK);
+    put(out, fingerprint(source));
+
+    put<std::uint64_t>(out, names.size());
+    for(const Atom & name : names){
+        put_string(out, name.asSymbol());
+        put<unsigned char>(out, env.is_proc(name) ? LambdaTag : ValueTag);
+        write(out, env.get_exp(name));
+    }
+
+    return static_cast<bool>(out);
+}
+
+bool Image::load(std::istream & in, Environment & env, const std::string & source){
+
+    char magic[sizeof(MAGIC)];
+    std::uint32_t version, order;
+    std::uint64_t print, count;
+    if(!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+       !get(in, version) || version != FORMAT_VERSION ||
+       !get(in, order) || order != ORDER_MARK ||
+       !get(in, print) || print != fingerprint(source) ||
+       !get(in, count)){
+        return false;
+    }
+
+    // read all definitions before adding any, so a corrupt image adds none
+    std::vector<std::pair<std::string, Expression>> values, lambdas;
+    for(std::uint64_t i = 0; i < count; ++i){
+        std::string name;
+        unsigned char tag;
+        Expression exp;
+        if(!get_string(in, name) || !get(in, tag) || tag > LambdaTag || !read(in, exp, 0)){
+            return false;
+        }
+
+        if(tag == LambdaTag){
+            lambdas.emplace_back(std::move(name), std::move(exp));
+        } else {
+            values.emplace_back(std::move(name), std::move(exp));
+        }
+    }
+
+    // the image must end where its last definition does
+    if(in.peek() != std::istream::traits_type::eof()){
+        return false;
+    }
+
+    for(const auto & value : values){
+        env.add_exp(Atom(value.first), value.second);
+    }
+
+    // lambdas are compiled when first called, folding only the built-ins
+    // their bodies do not redefine
+    for(const auto & lambda : lambdas){
+        env.declare_definitions(lambda.second);
+        env.add_proc(Atom(lambda.first), lambda.second);
+    }
+
+    return true;
+}
+
+void Image::write(std::ostream & out, const Expression & exp){
+
+    const Atom & head = exp.head();
+    if(head.isNumber()){
+        put<unsigned char>(out, NumberTag);
+        put(out, head.asNumber());
+    }
+    else if(head.isComplex()){
+        put<unsigned char>(out, ComplexTag);
+        put(out, head.asComplex().real());
+        put(out, head.asComplex().imag());
+    }
+    else if(head.isUserString()){
+        put<unsigned char>(out, UserStringTag);
+        put_string(out, head.asSymbol());
+    }
+    else if(head.isNone()){
+        put<unsigned char>(out, NoneTag);
+    }
+    else{
+        // symbols, including the list and lambda heads
+        put<unsigned char>(out, SymbolTag);
+        put_string(out, head.asSymbol());
+    }
+
+    // a packed tail is stored as its numbers
+    std::uint64_t size = exp.tailSize();
+    const double * numbers = exp.tailNumbers();
+    put<unsigned char>(out, numbers != nullptr);
+    put(out, size);
+    if(numbers != nullptr){
+        out.write(reinterpret_cast<const char *>(numbers), size * sizeof(double));
+    }
+    else{
+        for(std::uint64_t i = 0; i < size; ++i){
+            write(out, exp.child(i));
+        }
+    }
+
+    std::uint64_t properties = exp.m_properties ? exp.m_properties->size() : 0;
+    put(out, properties);
+    for(std::uint64_t i = 0; i < properties; ++i){
+        const auto & property = (*exp.m_properties)[i];
+        put_string(out, SymbolTable::instance().name(property.first));
+        write(out, property.second);
+    }
+}
+
+bool Image::read(std::istream & in, Expression & exp, std::size_t depth){
+
+    if(depth > MAX_DEPTH){
+        return false;
+    }
+
+    unsigned char tag;
+    if(!get(in, tag)){
+        return false;
+    }
+
+    Atom head;
+    switch(tag){
+        case NoneTag:
+            break;
+        case NumberTag: {
+            double value;
+            if(!get(in, value)) return false;
+            head = Atom(value);
+            break;
+        }
+        case ComplexTag: {
+            double real, imag;
+            if(!get(in, real) || !get(in, imag)) return false;
+            head = Atom(std::complex<double>(real, imag));
+            break;
+        }
+        case SymbolTag: {
+            std::string name;
+            if(!get_string(in, name) || name.empty()) return false;
+            head = Atom(name);
+            break;
+        }
+        case UserStringTag: {
+            std::string value;
+            if(!get_string(in, value)) return false;
+            head.setUserString(value);
+            break;
+        }
+        default:
+            return false;
+    }
+
+    unsigned char packed;
+    std::uint64_t size;
+    if(!get(in, packed) || packed > 1 || !get(in, size)){
+        return false;
+    }
+
+    if(packed){
+        std::vector<double> numbers;
+        for(std::uint64_t i = 0; i < size; ++i){
+            double value;
+            if(!get(in, value)) return false;
+            numbers.push_back(value);
+        }
+        exp = Expression(std::move(numbers));
+        exp.setHead(head);
+    }
+    else{
+        exp = Expression(head);
+        for(std::uint64_t i = 0; i < size; ++i){
+            Expression item;
+            if(!read(in, item, depth + 1)) return false;
+            exp.append(std::move(item));
+        }
+    }
+
+    std::uint64_t properties;
+    if(!get(in, properties)){
+        return false;
+    }
+
+    if(properties > 0){
+        auto list = std::make_shared<Expression::PropertyList>();
+        for(std::uint64_t i = 0; i < properties; ++i){
+            std::string key;
+            Expression value;
+            if(!get_string(in, key) || key.empty() || !read(in, value, depth + 1)) return false;
+            list->emplace_back(SymbolTable::instance().intern(key), std::move(value));
+        }
+        exp.m_properties = std::move(list);
+    }
+
+    return true;
+}
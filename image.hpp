@@ -0,0 +1,67 @@
+/*! \file image.hpp
+ Defines the binary image the definitions of an environment are saved to,
+ e.g. those made by the startup file, so they can be restored without
+ parsing and evaluating the program that made them.
+ */
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+// system includes
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// module includes
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \class Image
+ \brief Saves the definitions of an environment to a binary stream and loads
+ them back.
+
+ An image records the source text of the program whose evaluation made the
+ definitions, by a fingerprint. load refuses an image saved for another
+ text, so a caller can fall back to evaluating the program when the image is
+ stale, as it does when the image is missing or corrupt.
+
+ Values, including their properties, are stored exactly. Lambdas are stored
+ as their values and compiled again when first called. The built-in
+ procedures are not stored, only the definitions made since the environment
+ was reset.
+
+ The image is meant to be read by the build that wrote it: numbers are
+ stored in the byte order of the machine, which load checks.
+ */
+class Image {
+public:
+
+    /*! Save the definitions of env.
+     \param out the stream to write the image to, opened in binary mode
+     \param env the environment to save
+     \param source the text of the program that made the definitions
+     \return false if a definition can not be saved, a lambda defined inside
+     the call of another and so referring to its arguments. Nothing is
+     written then.
+     */
+    static bool save(std::ostream & out, const Environment & env, const std::string & source);
+
+    /*! Restore the definitions saved in an image into env.
+     \param in the stream to read the image from, opened in binary mode
+     \param env the environment to add the definitions to
+     \param source the text of the program the image must have been saved for
+     \return true if the image was loaded, false if it is stale or corrupt,
+     in which case env is unchanged
+     */
+    static bool load(std::istream & in, Environment & env, const std::string & source);
+
+private:
+
+    // write exp, with its tail and properties
+    static void write(std::ostream & out, const Expression & exp);
+
+    // read an expression written by write into exp, false on a read error
+    static bool read(std::istream & in, Expression & exp, std::size_t depth);
+};
+
+#endif
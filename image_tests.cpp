@@ -0,0 +1,129 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "environment.hpp"
+#include "image.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+static Expression eval(Interpreter & interp, const std::string & program){
+
+    std::istringstream iss(program);
+    REQUIRE(interp.parseStream(iss));
+    return interp.evaluate();
+}
+
+static const std::string STARTUP =
+    "(begin"
+    "(define make-point (lambda (x y) (set-property \"object-name\" \"point\" (list x y))))"
+    "(define origin (make-point 0 0))"
+    "(define z (+ 1 (* 2 I)))"
+    "(define numbers (list 1 2 3))"
+    "(define nested (list \"a\" (list 1 (list)) z))"
+    "(define circle (lambda (r) (* pi r r)))"
+    "(define area (lambda (x) (circle x)))"
+    ")";
+
+TEST_CASE( "Test image round trip", "[image]" ) {
+
+    Interpreter source;
+    eval(source, STARTUP);
+
+    std::stringstream image;
+    REQUIRE(source.saveImage(image, STARTUP));
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        image.clear();
+        image.seekg(0);
+
+        Interpreter loaded;
+        loaded.setEvaluationMode(mode);
+        REQUIRE(loaded.loadImage(image, STARTUP));
+
+        // values are restored exactly, with their properties
+        for(std::string name : {"origin", "z", "numbers", "nested"}){
+            std::string program = "(begin " + name + ")";
+            REQUIRE(eval(loaded, program).identical(eval(source, program)));
+        }
+
+        REQUIRE(eval(loaded, "(get-property \"object-name\" origin)") ==
+                eval(source, "(get-property \"object-name\" origin)"));
+        REQUIRE(eval(loaded, "(get-property \"object-name\" (make-point 1 2))") ==
+                eval(source, "(get-property \"object-name\" origin)"));
+        REQUIRE(eval(loaded, "(area 2)") == eval(source, "(area 2)"));
+        REQUIRE(eval(loaded, "(map circle (list 1 2 3))") == eval(source, "(map circle (list 1 2 3))"));
+    }
+}
+
+TEST_CASE( "Test image of lambdas redefining built-ins", "[image]" ) {
+
+    const std::string program = "(define setpi (lambda (x) (define pi x)))";
+
+    Interpreter source;
+    eval(source, program);
+
+    std::stringstream image;
+    REQUIRE(source.saveImage(image, program));
+
+    // the loaded lambda may redefine pi, which must so not be folded
+    Interpreter loaded;
+    REQUIRE(loaded.loadImage(image, program));
+    eval(loaded, "(define circle (lambda (r) (* pi r r)))");
+    eval(loaded, "(setpi 3)");
+    REQUIRE(eval(loaded, "(circle 1)") == Expression(3.));
+}
+
+TEST_CASE( "Test stale and corrupt images", "[image]" ) {
+
+    Interpreter source;
+    eval(source, STARTUP);
+
+    std::stringstream image;
+    REQUIRE(source.saveImage(image, STARTUP));
+    const std::string bytes = image.str();
+
+    // saved for another program
+    {
+        std::istringstream in(bytes);
+        Interpreter loaded;
+        REQUIRE(!loaded.loadImage(in, STARTUP + " "));
+        REQUIRE_THROWS_AS(eval(loaded, "(+ z 0)"), const SemanticError &);
+    }
+
+    // truncated anywhere, nothing is defined
+    for(std::size_t size = 0; size < bytes.size(); size += 7){
+        std::istringstream in(bytes.substr(0, size));
+        Interpreter loaded;
+        REQUIRE(!loaded.loadImage(in, STARTUP));
+        REQUIRE_THROWS_AS(eval(loaded, "(+ z 0)"), const SemanticError &);
+    }
+
+    // trailing bytes
+    {
+        std::istringstream in(bytes + "x");
+        Interpreter loaded;
+        REQUIRE(!loaded.loadImage(in, STARTUP));
+    }
+
+    // not an image
+    {
+        std::istringstream in("(define z 1)");
+        Interpreter loaded;
+        REQUIRE(!loaded.loadImage(in, STARTUP));
+    }
+}
+
+TEST_CASE( "Test image of closures", "[image]" ) {
+
+    const std::string program = "(begin (define adder (lambda (x) (define add (lambda (y) (+ x y))))) (adder 1))";
+
+    Interpreter source;
+    eval(source, program);
+
+    // add refers to the argument of the call of adder that defined it
+    std::stringstream image;
+    REQUIRE(!source.saveImage(image, program));
+    REQUIRE(image.str().empty());
+}
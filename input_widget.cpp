@@ -37,9 +37,25 @@ void InputWidget::evaluateStartupFile(){
     if(!startup_stream){
         parseError = true;
         exp = Expression(Atom("Could not open startup file for reading."));
+        return;
     }
     
-    if(!interp.parseStream(startup_stream)){
+    std::ostringstream contents;
+    contents << startup_stream.rdbuf();
+    std::string text = contents.str();
+    
+    // the build saves the definitions of the startup file as an image, to
+    // load while the file is unchanged
+    std::ifstream image_stream(STARTUP_IMAGE, std::ios::binary);
+    if(image_stream && interp.loadImage(image_stream, text)){
+        parseError = false;
+        exceptionError = false;
+        return;
+    }
+    
+    std::istringstream program(text);
+    
+    if(!interp.parseStream(program)){
         parseError = true;
         exp = Expression(Atom("Invalid Program. Could not parse start up file."));
     }
@@ -84,7 +100,7 @@ void InputWidget::evaluateText(){
 
 }
 
-Expression InputWidget::getResult(){
+const Expression & InputWidget::getResult() const{
     return exp;
 }
 
@@ -20,7 +20,7 @@ public:
     void keyPressEvent(QKeyEvent *ev);
     
     // Helper methods to get expression and errors
-    Expression getResult();
+    const Expression & getResult() const;
     bool checkParseError();
     bool checkExceptionError();
     
@@ -1,26 +1,159 @@
 #include "interpreter.hpp"
 
 // system includes
+#include <exception>
+#include <iterator>
 #include <stdexcept>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 // module includes
 #include "token.hpp"
 #include "parse.hpp"
+#include "compiler.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
+#include "image.hpp"
 #include "semantic_error.hpp"
 
-bool Interpreter::parseStream(std::istream & expression) noexcept{
+Interpreter::Interpreter(const Environment & base): env(base){}
+
+Environment Interpreter::snapshot() const{
+    
+    return env;
+}
+
+void Interpreter::restore(const Environment & snapshot){
+    
+    env.restore(snapshot);
+}
+
+bool Interpreter::saveImage(std::ostream & out, const std::string & source) const{
+    
+    return Image::save(out, env, source);
+}
+
+bool Interpreter::loadImage(std::istream & in, const std::string & source){
     
-    TokenSequenceType tokens = tokenize(expression);
+    return Image::load(in, env, source);
+}
+
+bool Interpreter::parseStream(std::istream & expression){
+    
+    std::string text((std::istreambuf_iterator<char>(expression)), std::istreambuf_iterator<char>());
+    
+    return parseBuffer(text.data(), text.size());
+}
+
+bool Interpreter::parseBuffer(const char * data, std::size_t size){
     
-    ast = parse(tokens);
+    // the tokens refer to the buffer, the AST does not
+    try{
+        ast = parse(tokenize(data, data + size));
+    }
+    catch(const SemanticError &){
+        // the symbol table is full
+        ast = Expression();
+    }
+    
+    // the program's definitions must be known before constants are folded
+    env.declare_definitions(ast);
+    program = compile(ast, &env);
     
     return (ast != Expression());
 };
 
 
-Expression Interpreter::evaluate(){
+// releases the temporaries of an evaluation when it ends, normally or by an
+// error. Nothing allocated from the arena is reachable from the environment
+// or the result by then.
+class ArenaReset {
+public:
+    ArenaReset(Arena & a): arena(a){}
+    ~ArenaReset(){
+        arena.reset();
+    }
+private:
+    Arena & arena;
+};
+
+// the C++ stack the tree walker runs on, which recurses for each lambda
+// call that is not a tail call. Enough for MAX_CALL_DEPTH calls of lambdas
+// with nested bodies, and only reserved: pages are used as it grows.
+static const std::size_t TREE_WALK_STACK = std::size_t(1) << 30;
+
+// an evaluation by the tree walker, run on a thread of its own
+struct TreeWalk {
+    const Expression & ast;
+    Environment & env;
+    Expression result;
+    std::exception_ptr error;
+};
+
+static void * run_tree_walk(void * arg){
+    
+    TreeWalk & walk = *static_cast<TreeWalk *>(arg);
+    try{
+        walk.result = walk.ast.eval(walk.env);
+    }
+    catch(...){
+        walk.error = std::current_exception();
+    }
+    return nullptr;
+}
+
+// evaluate ast with the tree walker on a thread with a TREE_WALK_STACK stack,
+// so it reaches MAX_CALL_DEPTH rather than overflowing the caller's stack
+static Expression tree_walk(const Expression & ast, Environment & env){
+    
+#ifndef _WIN32
+    TreeWalk walk{ast, env, Expression(), nullptr};
     
+    pthread_attr_t attr;
+    if(pthread_attr_init(&attr) == 0){
+        pthread_t thread;
+        bool started = (pthread_attr_setstacksize(&attr, TREE_WALK_STACK) == 0) &&
+            (pthread_create(&thread, &attr, run_tree_walk, &walk) == 0);
+        pthread_attr_destroy(&attr);
+        
+        if(started){
+            pthread_join(thread, nullptr);
+            if(walk.error){
+                std::rethrow_exception(walk.error);
+            }
+            return walk.result;
+        }
+    }
+#endif
+    
+    // limited by the caller's stack
     return ast.eval(env);
 }
+
+Expression Interpreter::evaluate(){
+    
+    ArenaReset release(env.get_arena());
+    
+    if(mode == TreeWalkMode){
+        return tree_walk(ast, env);
+    }
+    
+    return vm.run(program, env);
+}
+
+void Interpreter::setEvaluationMode(EvaluationMode m) noexcept{
+    
+    mode = m;
+}
+
+void Interpreter::setMemoCapacity(std::size_t capacity){
+    
+    env.set_memo_capacity(capacity);
+}
+
+const MemoCache * Interpreter::getMemoCache() const noexcept{
+    
+    return env.get_memo();
+}
@@ -9,36 +9,114 @@
 
 // system includes
 #include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
 
 // module includes
+#include "compiler.hpp"
 #include "environment.hpp"
 #include "expression.hpp"
 #include "map.hpp"
 #include "queue.hpp"
+#include "vm.hpp"
 
 /*! \class Interpreter
  \brief Class to parse and evaluate an expression (program)
  
  Interpreter has an Environment, which starts at a default.
- The parse method builds an internal AST.
+ The parse method builds an internal AST and compiles it to bytecode.
  The eval method updates Environment and returns last result.
  */
 class Interpreter {
 public:
     
+    /*! \enum EvaluationMode
+     \brief how evaluate executes the parsed program
+     */
+    enum EvaluationMode { BytecodeMode, //< run the compiled bytecode on the VirtualMachine
+        TreeWalkMode //< walk the AST with Expression::eval, on a thread with a deep stack
+    };
+    
+    /*! Construct an interpreter with the default environment. */
+    Interpreter() = default;
+    
+    /*! Construct an interpreter with the definitions of a snapshot (see
+     snapshot), in constant time. Many independent interpreters can so start
+     from one environment, e.g. that of the startup file, set up once.
+     \param base the environment to start from
+     */
+    explicit Interpreter(const Environment & base);
+    
+    /*! Capture the definitions made so far, in constant time. They are shared
+     with the interpreter until it changes them.
+     \return the snapshot, to restore or construct other interpreters from
+     */
+    Environment snapshot() const;
+    
+    /*! Return to the definitions of a snapshot, in constant time.
+     \param snapshot the environment to take the definitions from
+     */
+    void restore(const Environment & snapshot);
+    
+    /*! Save the definitions made so far to a binary image (see Image).
+     \param out the stream to write the image to, opened in binary mode
+     \param source the text of the program that made the definitions
+     \return false if a definition can not be saved
+     */
+    bool saveImage(std::ostream & out, const std::string & source) const;
+    
+    /*! Add the definitions saved in an image, instead of evaluating the
+     program they were saved for.
+     \param in the stream to read the image from, opened in binary mode
+     \param source the text of the program the image must have been saved for
+     \return true if the image was loaded, false if it is stale or corrupt,
+     in which case the definitions are unchanged
+     */
+    bool loadImage(std::istream & in, const std::string & source);
+    
     /*! Parse into an internal Expression from a stream
      \param expression the raw text stream repreenting the candidate expression
      \return true on successful parsing
+     \throws std::bad_alloc if memory runs out
+     */
+    bool parseStream(std::istream &expression);
+    
+    /*! Parse into an internal Expression from a buffer, tokenizing it in
+     place (see tokenize), which is faster for large programs than reading a
+     stream.
+     \param data the characters of the candidate expression
+     \param size the number of characters
+     \return true on successful parsing, false also if the program has more
+     symbols than fit in the symbol table
+     \throws std::bad_alloc if memory runs out
      */
-    bool parseStream(std::istream &expression) noexcept;
+    bool parseBuffer(const char * data, std::size_t size);
     
-    /*! Evaluate the Expression by walking the tree, returning the result.
+    /*! Evaluate the parsed program, returning the result.
      \return the Expression resulting from the evaluation in the current environment
      \throws SemanticError when a semantic error is encountered
      */
     Expression evaluate();
     
+    /*! Select how evaluate executes the program, the default is BytecodeMode.
+     \param mode the evaluation mode to use from now on
+     */
+    void setEvaluationMode(EvaluationMode mode) noexcept;
+    
+    /*! Enable caching the results of calls to lambdas without side effects
+     that depend only on their arguments (see Environment::get_purity), or
+     disable it. Disabled by default.
+     \param capacity the maximum number of results to cache, 0 to disable
+     */
+    void setMemoCapacity(std::size_t capacity);
+    
+    /*! Get the cache of results of lambda calls, e.g. for its hit and miss
+     counts.
+     \return the cache, or nullptr if caching is disabled
+     */
+    const MemoCache * getMemoCache() const noexcept;
+    
 private:
     
     // the environment
@@ -46,6 +124,15 @@ private:
     
     // the AST
     Expression ast;
+    
+    // the AST compiled to bytecode
+    std::shared_ptr<const Chunk> program;
+    
+    // the machine running the bytecode
+    VirtualMachine vm;
+    
+    // how to evaluate
+    EvaluationMode mode = BytecodeMode;
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include "catch.hpp"
 
+#include <cmath>
 #include <string>
 #include <sstream>
 #include <fstream>
@@ -818,6 +819,81 @@ TEST_CASE( "Test Interpreter result with simple procedures (join)", "[interprete
     
 }
 
+TEST_CASE( "Test Interpreter keeps lists of numbers packed", "[interpreter]" ) {
+    
+    std::vector<std::string> programs = {"(range 0 5 1)",
+        "(list 1 2 3)",
+        "(map sin (range 0 1 0.5))",
+        "(begin (define sq (lambda (x) (* x x))) (map sq (range 0 5 1)))",
+        "(join (range 0 2 1) (list 3 4))",
+        "(append (rest (range 0 2 1)) 3)"};
+    
+    for(auto program : programs){
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result.tailNumbers() != nullptr);
+    }
+    
+    {
+        std::string program = "(join (range 0 1 1) (list \"a\"))";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result.tailNumbers() == nullptr);
+        REQUIRE(result.tailSize() == 3);
+        REQUIRE(*result.tailConstBegin() == Expression(0.));
+    }
+}
+
+TEST_CASE( "Test Interpreter broadcasts arithmetic over lists", "[interpreter]" ) {
+    
+    std::vector<std::pair<std::string, std::string>> cases = {
+        {"(+ (list 1 2) (list 3 4))", "(list 4 6)"},
+        {"(+ 1 (list 1 2) 2)", "(list 4 5)"},
+        {"(* 2 (range 0 2 1))", "(list 0 2 4)"},
+        {"(- (list 1 2))", "(list -1 -2)"},
+        {"(- 10 (list 1 2))", "(list 9 8)"},
+        {"(/ (list 2 4) 2)", "(list 1 2)"},
+        {"(/ (list 2 4))", "(list 0.5 0.25)"},
+        {"(^ (list 2 3) 2)", "(list 4 9)"},
+        {"(sqrt (list 4 9))", "(list 2 3)"},
+        {"(ln (list 1))", "(list 0)"},
+        {"(sin (list 0))", "(list 0)"},
+        {"(cos (list 0))", "(list 1)"},
+        {"(tan (list 0))", "(list 0)"},
+        {"(+ I (list 1 2))", "(list (+ I 1) (+ I 2))"},
+        {"(* 2 (list (list 1 2) (list 3 4)))", "(list (list 2 4) (list 6 8))"},
+        {"(+ (list) 1)", "(list)"}};
+    
+    for(auto c : cases){
+        INFO(c.first);
+        REQUIRE(run(c.first) == run(c.second));
+    }
+    
+    {
+        INFO("the result of packed arguments is packed");
+        REQUIRE(run("(sin (range 0 1 0.5))").tailNumbers() != nullptr);
+        REQUIRE(run("(+ (range 0 1 0.5) (range 0 1 0.5))").tailNumbers() != nullptr);
+    }
+    
+    {
+        INFO("negative square roots are complex");
+        Expression result = run("(sqrt (list -4 4))");
+        REQUIRE(result.tailSize() == 2);
+        REQUIRE(result.tailAt(0) == Expression(std::complex<double>(0, 2)));
+        REQUIRE(result.tailAt(1) == Expression(2.));
+    }
+    
+    std::vector<std::string> errors = {"(+ (list 1 2) (list 1))",
+        "(ln (list -1))",
+        "(+ (list 1) (list \"a\"))",
+        "(- (list 1) 2 3)"};
+    
+    for(auto program : errors){
+        INFO(program);
+        REQUIRE(runError(program) == Expression());
+    }
+}
+
 TEST_CASE( "Test Interpreter result with simple procedures (range)", "[interpreter]" ) {
     
     { // range, simple case of range
@@ -903,6 +979,38 @@ TEST_CASE( "Test Interpreter result with simple procedures (lambda)", "[interpre
         
         REQUIRE(result == Expression(15));
     }
+    
+    { // lambda, parameters do not overwrite global definitions
+        std::string program = "(begin (define x 100) (define f (lambda (x) x)) (f 2) x)";
+        INFO(program);
+        Expression result = run(program);
+        
+        REQUIRE(result == Expression(100));
+    }
+    
+    { // lambda, nested calls do not overwrite each others parameters
+        std::string program = "(begin (define id (lambda (x) x)) (define f (lambda (x) (+ (id 1) x))) (f 10))";
+        INFO(program);
+        Expression result = run(program);
+        
+        REQUIRE(result == Expression(11));
+    }
+    
+    { // lambda, nested lambda sees the parameters of the enclosing call
+        std::string program = "(begin (define f (lambda (x) (begin (define g (lambda (y) (+ x y))) (g 1)))) (f 10))";
+        INFO(program);
+        Expression result = run(program);
+        
+        REQUIRE(result == Expression(11));
+    }
+    
+    { // lambda, nested lambda keeps the parameters after the enclosing call returns
+        std::string program = "(begin (define f (lambda (x) (begin (define g (lambda (y) (+ x y))) x))) (f 10) (f 20) (g 1))";
+        INFO(program);
+        Expression result = run(program);
+        
+        REQUIRE(result == Expression(21));
+    }
 }
 
 TEST_CASE( "Test Interpreter result with simple procedures (apply)", "[interpreter]" ) {
@@ -1006,6 +1114,84 @@ TEST_CASE( "Test Interpreter result with simple procedures (map)", "[interpreter
 }
 
 
+TEST_CASE( "Test Interpreter result with parallel map (pmap)", "[interpreter]" ) {
+    
+    { // pmap, agrees with map and keeps the order of the list
+        std::string program = "(begin (define sq (lambda (x) (* x x))) (pmap sq (range 0 1000 1)))";
+        INFO(program);
+        Expression result = run(program);
+        Expression expectedResult = run("(begin (define sq (lambda (x) (* x x))) (map sq (range 0 1000 1)))");
+        
+        REQUIRE(result.tailSize() == 1001);
+        REQUIRE(result == expectedResult);
+    }
+    
+    { // pmap, with a builtin procedure and a computed list
+        std::string program = "(begin (define a (list 1 2 4)) (pmap / a))";
+        INFO(program);
+        Expression result = run(program);
+        Expression expectedResult;
+        expectedResult.setHead(Atom("list"));
+        expectedResult.append(Atom(1));
+        expectedResult.append(Atom(0.5));
+        expectedResult.append(Atom(0.25));
+        
+        REQUIRE(result == expectedResult);
+    }
+    
+    { // pmap, nested in the procedure of another
+        std::string program = "(begin (define inc (lambda (x) (+ x 1))) (define f (lambda (n) (first (pmap inc (range n (+ n 10) 1))))) (pmap f (range 1 50 1)))";
+        INFO(program);
+        Expression result = run(program);
+        
+        REQUIRE(result.tailSize() == 50);
+        REQUIRE(result.tailAt(49) == Expression(51.));
+    }
+    
+    { // pmap, a procedure that defines runs in order, keeping its definitions as map does
+        std::string program = "(begin (define f (lambda (x) (begin (define y x) y))) (pmap f (list 1 2 3)) y)";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(3.));
+    }
+    
+    { // pmap, the error of the first element to fail is raised
+        std::string program = "(begin (define f (lambda (x) (if (< x 300) x (if (< x 301) (first (list)) (first 1))))) (pmap f (range 0 1000 1)))";
+        INFO(program);
+        
+        std::istringstream iss(program);
+        Interpreter interp;
+        REQUIRE(interp.parseStream(iss));
+        
+        std::string message;
+        try{
+            interp.evaluate();
+        }
+        catch(const SemanticError & ex){
+            message = ex.what();
+        }
+        REQUIRE(message == "Error: argument to first is an empty list");
+    }
+    
+    { // pmap, throw error first argument not procedure
+        std::string program = "(pmap 3 (list 1 2 3))";
+        INFO(program);
+        Expression result = runError(program);
+    }
+    
+    { // pmap, throw error second argument not list
+        std::string program = "(pmap + 3)";
+        INFO(program);
+        Expression result = runError(program);
+    }
+    
+    { // pmap, throw error wrong number of arguments
+        std::string program = "(pmap + (list 1) (list 2))";
+        INFO(program);
+        Expression result = runError(program);
+    }
+}
+
 TEST_CASE( "Test Interpreter result with simple procedures (list)", "[interpreter]" ) {
     
     { // list, simple empty list
@@ -1125,6 +1311,81 @@ TEST_CASE( "Test interpreter with user strings (user strings)", "[interpreter]"
     
 }
 
+TEST_CASE( "Test Interpreter result with simple procedures (less)", "[interpreter]" ) {
+    
+    {
+        std::string program = "(< 1 2)";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(1.));
+    }
+    
+    {
+        std::string program = "(< 2 1)";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(0.));
+    }
+    
+    {
+        std::string program = "(< 1 I)";
+        INFO(program);
+        runError(program);
+    }
+    
+    {
+        std::string program = "(< 1 2 3)";
+        INFO(program);
+        runError(program);
+    }
+}
+
+TEST_CASE( "Test Interpreter special forms: if", "[interpreter]" ) {
+    
+    {
+        std::string program = "(begin (define a 1) (define b pi) (if (< a b) b a))";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(atan2(0, -1)));
+    }
+    
+    {
+        std::string program = "(if 0 (undefined) 2)";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(2.));
+    }
+    
+    {
+        std::string program = "(if 1 2)";
+        INFO(program);
+        runError(program);
+    }
+    
+    {
+        std::string program = "(if (list) 1 2)";
+        INFO(program);
+        runError(program);
+    }
+}
+
+TEST_CASE( "Test Interpreter tail calls", "[interpreter]" ) {
+    
+    { // deeper than the C++ stack allows for non-tail recursion
+        std::string program = "(begin (define count (lambda (n acc) (if (< n 1) acc (begin (define m (- n 1)) (count m (+ acc 1)))))) (count 200000 0))";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(200000.));
+    }
+    
+    { // through apply
+        std::string program = "(begin (define count (lambda (n) (if (< n 1) n (apply count (list (- n 1)))))) (count 200000))";
+        INFO(program);
+        Expression result = run(program);
+        REQUIRE(result == Expression(0.));
+    }
+}
+
 TEST_CASE( "Test Interpreter special forms: begin and define", "[interpreter]" ) {
     
     {
@@ -1203,7 +1464,7 @@ TEST_CASE( "Test for exceptions from semantically incorrect input", "[interprete
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
     
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 TEST_CASE( "Test malformed define", "[interpreter]" ) {
@@ -1219,7 +1480,7 @@ TEST_CASE( "Test malformed define", "[interpreter]" ) {
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
     
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 TEST_CASE( "Test using number as procedure", "[interpreter]" ) {
@@ -1234,7 +1495,7 @@ TEST_CASE( "Test using number as procedure", "[interpreter]" ) {
     bool ok = interp.parseStream(iss);
     REQUIRE(ok == true);
     
-    REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+    REQUIRE_THROWS_AS(interp.evaluate(), const SemanticError &);
 }
 
 void worker(Map & map){
@@ -1266,3 +1527,69 @@ TEST_CASE( "Test thread safe map", "[interpreter]" ) {
     th1.join();
     th2.join();
 }
+
+TEST_CASE( "Test folded constants keep their meaning", "[interpreter]" ) {
+    
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        
+        Interpreter interp;
+        interp.setEvaluationMode(mode);
+        
+        auto eval = [&interp](const std::string & program){
+            std::istringstream iss(program);
+            REQUIRE(interp.parseStream(iss));
+            return interp.evaluate();
+        };
+        
+        const double pi = std::atan2(0, -1);
+        
+        Expression lambda = eval("(define f (lambda (x) (* x (* 2 pi))))");
+        
+        // the value of the lambda is printed with its body as written
+        REQUIRE(lambda.tailAt(1).tailAt(1).tailSize() == 2);
+        REQUIRE(eval("(f 1)") == Expression(2 * pi));
+        
+        // a later program redefining pi changes lambdas compiled before it
+        eval("(define pi 3)");
+        REQUIRE(eval("(f 1)") == Expression(6.));
+        
+        // as does a redefinition by a lambda defined after them
+        eval("(define g (lambda (x) (* x e)))");
+        REQUIRE(eval("(g 1)") == Expression(std::exp(1)));
+        eval("(define h (lambda (y) (begin (define e 1) (g y))))");
+        REQUIRE(eval("(h 2)") == Expression(2.));
+        
+        // an error in a branch not taken is not raised
+        REQUIRE(eval("(if 1 (sqrt 4) (ln (- 1)))") == Expression(2.));
+        REQUIRE_THROWS(eval("(ln (- 1))"));
+    }
+}
+
+TEST_CASE( "Test interpreter snapshots", "[interpreter]" ) {
+    
+    auto eval = [](Interpreter & interp, const std::string & program){
+        std::istringstream iss(program);
+        REQUIRE(interp.parseStream(iss));
+        return interp.evaluate();
+    };
+    
+    Interpreter interp;
+    eval(interp, "(define square (lambda (x) (* x x)))");
+    Environment base = interp.snapshot();
+    
+    eval(interp, "(define square 2)");
+    eval(interp, "(define b 3)");
+    REQUIRE(eval(interp, "(+ square b)") == Expression(5.));
+    
+    interp.restore(base);
+    REQUIRE(eval(interp, "(square 3)") == Expression(9.));
+    REQUIRE_THROWS(eval(interp, "(+ b 1)"));
+    
+    // interpreters started from the snapshot are independent of each other
+    Interpreter first(base);
+    Interpreter second(base);
+    eval(first, "(define c 1)");
+    REQUIRE(eval(second, "(square 4)") == Expression(16.));
+    REQUIRE_THROWS(eval(second, "(+ c 1)"));
+    REQUIRE(eval(first, "(+ c 1)") == Expression(2.));
+}
@@ -25,10 +25,10 @@ void InterpreterThread::runInterpreter(MessageQueue<std::string> & inputQueue, M
             }
             else{
                 try{
-                    Expression exp = (*interp).evaluate(); // Output created
+                    outputMsg.expression = (*interp).evaluate(); // Output created
                     outputMsg.isError = false;
-                    outputMsg.expression = exp;
-                    outputQueue.push(outputMsg);
+                    outputMsg.errorMsg.clear();
+                    outputQueue.push(std::move(outputMsg));
                 }
                 catch(const SemanticError & ex){
                     outputMsg.isError = true;
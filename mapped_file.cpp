@@ -0,0 +1,71 @@
+#include "mapped_file.hpp"
+
+// system includes
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string & filename): m_data(nullptr), m_size(0), mapped(false),
+opened(false){
+
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd >= 0){
+        struct stat info;
+        if(::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+            void * address = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(address != MAP_FAILED){
+                // the file is read front to back
+                ::madvise(address, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+                m_data = static_cast<const char *>(address);
+                m_size = static_cast<std::size_t>(info.st_size);
+                mapped = true;
+                opened = true;
+            }
+        }
+        ::close(fd);
+    }
+    if(mapped){
+        return;
+    }
+#endif
+
+    // read the contents instead, e.g. of an empty file, which can not be mapped
+    std::ifstream stream(filename, std::ios::binary);
+    if(stream){
+        contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        m_data = contents.data();
+        m_size = contents.size();
+        opened = true;
+    }
+}
+
+MappedFile::~MappedFile(){
+
+#ifndef _WIN32
+    if(mapped){
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif
+}
+
+bool MappedFile::is_open() const noexcept{
+
+    return opened;
+}
+
+const char * MappedFile::data() const noexcept{
+
+    return m_data;
+}
+
+std::size_t MappedFile::size() const noexcept{
+
+    return m_size;
+}
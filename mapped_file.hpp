@@ -0,0 +1,56 @@
+/*! \file mapped_file.hpp
+ Defines a read-only view of the contents of a file, mapped into memory.
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+// system includes
+#include <cstddef>
+#include <string>
+
+/*! \class MappedFile
+ \brief The contents of a file, mapped read-only into memory.
+
+ On POSIX systems the file is mapped with mmap, so its pages are read from
+ the page cache as they are first accessed, without being copied. Elsewhere,
+ and for files that can not be mapped, e.g. pipes, the contents are read
+ into memory instead. Either way they are contiguous, e.g. for tokenize.
+ */
+class MappedFile {
+public:
+
+    /// map the file with the given name, check is_open for success
+    explicit MappedFile(const std::string & filename);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    /// unmap the file
+    ~MappedFile();
+
+    /// return true if the file could be opened and read
+    bool is_open() const noexcept;
+
+    /// return the first character of the contents, not null-terminated
+    const char * data() const noexcept;
+
+    /// return the number of characters of the contents
+    std::size_t size() const noexcept;
+
+private:
+
+    // the contents, mapped or in contents
+    const char * m_data;
+    std::size_t m_size;
+
+    // true if m_data is mapped
+    bool mapped;
+
+    // true if the file was opened
+    bool opened;
+
+    // the contents, if they could not be mapped
+    std::string contents;
+};
+
+#endif
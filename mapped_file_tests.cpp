@@ -0,0 +1,55 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "token.hpp"
+
+// write contents to a file, removed when the test ends
+class TemporaryFile {
+public:
+    TemporaryFile(const std::string & name, const std::string & contents): filename(name){
+        std::ofstream out(filename, std::ios::binary);
+        out << contents;
+    }
+    ~TemporaryFile(){
+        std::remove(filename.c_str());
+    }
+    const std::string filename;
+};
+
+TEST_CASE( "Test mapping a file", "[mapped_file]" ) {
+
+    std::string program = "(define a 1)\n; comment\n(+ a 2)";
+    TemporaryFile file("mapped_file_test.pls", program);
+
+    MappedFile mapped(file.filename);
+    REQUIRE(mapped.is_open());
+    REQUIRE(std::string(mapped.data(), mapped.size()) == program);
+
+    // the forms are found where the file is mapped
+    FormReader reader(mapped.data(), mapped.data() + mapped.size());
+    const char * first;
+    const char * last;
+    REQUIRE(reader.next(first, last));
+    REQUIRE(first == mapped.data());
+    REQUIRE(std::string(first, last) == "(define a 1)");
+    REQUIRE(reader.next(first, last));
+    REQUIRE(std::string(first, last) == "(+ a 2)");
+    REQUIRE(last == mapped.data() + mapped.size());
+    REQUIRE(!reader.next(first, last));
+}
+
+TEST_CASE( "Test mapping empty and missing files", "[mapped_file]" ) {
+
+    TemporaryFile file("mapped_file_empty.pls", "");
+
+    MappedFile empty(file.filename);
+    REQUIRE(empty.is_open());
+    REQUIRE(empty.size() == 0);
+
+    MappedFile missing("mapped_file_missing.pls");
+    REQUIRE(!missing.is_open());
+}
@@ -0,0 +1,131 @@
+#include "memo.hpp"
+
+// system includes
+#include <functional>
+#include <iterator>
+
+MemoCache::Key::Key(SymbolId op, std::vector<Expression> args):
+procedure(op), arguments(std::move(args)), hash(std::hash<SymbolId>()(op)){
+
+    for(const Expression & arg : arguments){
+        hash = hash * 31 + arg.hash();
+    }
+}
+
+MemoCache::MemoCache(std::size_t capacity): limit(capacity), hitCount(0), missCount(0){}
+
+MemoCache::Entries::iterator MemoCache::lookup(const Key & key){
+
+    auto range = index.equal_range(key.hash);
+    for(auto it = range.first; it != range.second; ++it){
+        const Key & other = it->second->first;
+
+        bool same = (other.procedure == key.procedure) && (other.arguments.size() == key.arguments.size());
+        for(std::size_t i = 0; same && i < key.arguments.size(); ++i){
+            same = other.arguments[i].identical(key.arguments[i]);
+        }
+
+        if(same){
+            return it->second;
+        }
+    }
+
+    return entries.end();
+}
+
+bool MemoCache::find(const Key & key, Expression & result){
+
+    auto entry = lookup(key);
+
+    if(entry == entries.end()){
+        ++missCount;
+        return false;
+    }
+
+    ++hitCount;
+    entries.splice(entries.begin(), entries, entry);
+    result = entry->second;
+    return true;
+}
+
+void MemoCache::insert(Key key, const Expression & result){
+
+    if(limit == 0){
+        return;
+    }
+
+    // a call may be inserted again, e.g. when it recursed into itself
+    auto entry = lookup(key);
+    if(entry != entries.end()){
+        entry->second = result;
+        entries.splice(entries.begin(), entries, entry);
+        return;
+    }
+
+    if(entries.size() == limit){
+        auto oldest = std::prev(entries.end());
+        auto range = index.equal_range(oldest->first.hash);
+        for(auto it = range.first; it != range.second; ++it){
+            if(it->second == oldest){
+                index.erase(it);
+                break;
+            }
+        }
+        entries.pop_back();
+    }
+
+    std::size_t hash = key.hash;
+    entries.emplace_front(std::move(key), result);
+    index.emplace(hash, entries.begin());
+}
+
+void MemoCache::begin_call(Key key){
+
+    calls.push_back(std::move(key));
+}
+
+std::size_t MemoCache::pending() const noexcept{
+
+    return calls.size();
+}
+
+void MemoCache::finish_calls(std::size_t mark, const Expression & result){
+
+    while(calls.size() > mark){
+        insert(std::move(calls.back()), result);
+        calls.pop_back();
+    }
+}
+
+void MemoCache::abandon_calls(std::size_t mark) noexcept{
+
+    while(calls.size() > mark){
+        calls.pop_back();
+    }
+}
+
+void MemoCache::clear() noexcept{
+
+    index.clear();
+    entries.clear();
+}
+
+std::size_t MemoCache::size() const noexcept{
+
+    return entries.size();
+}
+
+std::size_t MemoCache::capacity() const noexcept{
+
+    return limit;
+}
+
+std::size_t MemoCache::hits() const noexcept{
+
+    return hitCount;
+}
+
+std::size_t MemoCache::misses() const noexcept{
+
+    return missCount;
+}
@@ -0,0 +1,120 @@
+/*! \file memo.hpp
+ Defines the cache of the results of calls to pure lambdas.
+ */
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+// system includes
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// module includes
+#include "expression.hpp"
+#include "symbol.hpp"
+
+/*! \class MemoCache
+ \brief A bounded cache mapping calls of pure lambdas to their results.
+
+ A call is identified by the symbol naming the lambda and its arguments,
+ compared exactly (see Expression::identical). The cache holds at most
+ capacity results, evicting the least recently used one when full, and
+ counts how often a lookup finds a result (hits) or not (misses).
+
+ Only lambdas the Environment classifies as Pure may be cached, and the
+ cache must be cleared when a procedure is redefined, as that may change
+ the result of a lambda calling it.
+
+ An evaluator starts a call with begin_call when its result is not cached
+ and records the result with finish_calls once the call returns. Several
+ calls may be pending at once; a call in tail position of another finishes
+ with the same result.
+ */
+class MemoCache {
+public:
+
+    /*! \class Key
+     \brief A call of a lambda: its name and argument values.
+     */
+    struct Key {
+
+        /// construct the key of a call of the lambda named op with arguments args
+        Key(SymbolId op, std::vector<Expression> args);
+
+        /// the interned name of the lambda
+        SymbolId procedure;
+
+        /// the argument values
+        std::vector<Expression> arguments;
+
+        /// the hash of procedure and arguments
+        std::size_t hash;
+    };
+
+    /// construct an empty cache holding at most capacity results
+    explicit MemoCache(std::size_t capacity);
+
+    /*! Look up the result of a call, marking it most recently used.
+     \param key the call
+     \param result set to the result if it is cached
+     \return true if the result is cached
+     */
+    bool find(const Key & key, Expression & result);
+
+    /*! Add the result of a call, evicting the least recently used result
+     if the cache is full.
+     \param key the call
+     \param result the value it returned
+     */
+    void insert(Key key, const Expression & result);
+
+    /// record that the call key has started, its result is not known yet
+    void begin_call(Key key);
+
+    /// return the number of calls begun and not yet finished or abandoned
+    std::size_t pending() const noexcept;
+
+    /// insert result for the calls begun since pending() returned mark
+    void finish_calls(std::size_t mark, const Expression & result);
+
+    /// forget the calls begun since pending() returned mark, e.g. after an error
+    void abandon_calls(std::size_t mark) noexcept;
+
+    /// remove all results, keeping the counts
+    void clear() noexcept;
+
+    /// return the number of cached results
+    std::size_t size() const noexcept;
+
+    /// return the maximum number of cached results
+    std::size_t capacity() const noexcept;
+
+    /// return the number of lookups that found a result
+    std::size_t hits() const noexcept;
+
+    /// return the number of lookups that did not find a result
+    std::size_t misses() const noexcept;
+
+private:
+
+    // the results, most recently used first
+    typedef std::list<std::pair<Key, Expression>> Entries;
+    Entries entries;
+
+    // the entries by hash of their key
+    std::unordered_multimap<std::size_t, Entries::iterator> index;
+
+    // calls begun whose results are not known yet
+    std::vector<Key> calls;
+
+    std::size_t limit;
+    std::size_t hitCount;
+    std::size_t missCount;
+
+    // return the entry for key, or entries.end()
+    Entries::iterator lookup(const Key & key);
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <sstream>
+
+#include "interpreter.hpp"
+#include "memo.hpp"
+
+// the key of a call of f with a single number argument
+MemoCache::Key call_of(const std::string & f, double x){
+
+    return MemoCache::Key(SymbolTable::instance().intern(f), std::vector<Expression>(1, Expression(x)));
+}
+
+TEST_CASE( "Test memo cache lookup", "[memo]" ) {
+
+    MemoCache memo(10);
+    Expression result;
+
+    REQUIRE(!memo.find(call_of("f", 1), result));
+    REQUIRE(memo.misses() == 1);
+
+    memo.insert(call_of("f", 1), Expression(2.));
+    REQUIRE(memo.size() == 1);
+
+    REQUIRE(memo.find(call_of("f", 1), result));
+    REQUIRE(result == Expression(2.));
+    REQUIRE(memo.hits() == 1);
+
+    // the procedure and the arguments must match exactly
+    REQUIRE(!memo.find(call_of("g", 1), result));
+    double next = std::nextafter(1., 2.);
+    REQUIRE(Expression(next) == Expression(1.));
+    REQUIRE(!memo.find(call_of("f", next), result));
+
+    memo.clear();
+    REQUIRE(memo.size() == 0);
+    REQUIRE(!memo.find(call_of("f", 1), result));
+}
+
+TEST_CASE( "Test memo cache keys compare structure and properties", "[memo]" ) {
+
+    Expression packed(std::vector<double>{1, 2});
+
+    // packed and ordinary tails of the same numbers are identical
+    Expression list(Atom("list"));
+    list.append(Atom(1.));
+    list.append(Expression(Atom(2.)));
+    REQUIRE(list.identical(packed));
+    REQUIRE(list.hash() == packed.hash());
+
+    Expression styled = packed;
+    styled.add_property(Expression(Atom("\"size\"")), Expression(1.));
+    REQUIRE(styled == packed);
+    REQUIRE(!styled.identical(packed));
+
+    REQUIRE(Expression(0.).identical(Expression(-0.)));
+    REQUIRE(Expression(0.).hash() == Expression(-0.).hash());
+}
+
+TEST_CASE( "Test memo cache evicts the least recently used result", "[memo]" ) {
+
+    MemoCache memo(2);
+    Expression result;
+
+    memo.insert(call_of("f", 1), Expression(1.));
+    memo.insert(call_of("f", 2), Expression(2.));
+
+    // using 1 makes 2 the least recently used
+    REQUIRE(memo.find(call_of("f", 1), result));
+
+    memo.insert(call_of("f", 3), Expression(3.));
+    REQUIRE(memo.size() == 2);
+    REQUIRE(memo.find(call_of("f", 1), result));
+    REQUIRE(memo.find(call_of("f", 3), result));
+    REQUIRE(!memo.find(call_of("f", 2), result));
+}
+
+TEST_CASE( "Test memo cache pending calls", "[memo]" ) {
+
+    MemoCache memo(10);
+    Expression result;
+
+    std::size_t mark = memo.pending();
+    memo.begin_call(call_of("f", 1));
+    memo.begin_call(call_of("g", 1));
+    REQUIRE(memo.pending() == mark + 2);
+
+    // a call in tail position of another returns the same result
+    memo.finish_calls(mark, Expression(5.));
+    REQUIRE(memo.pending() == mark);
+    REQUIRE(memo.find(call_of("f", 1), result));
+    REQUIRE(result == Expression(5.));
+    REQUIRE(memo.find(call_of("g", 1), result));
+
+    memo.begin_call(call_of("h", 1));
+    memo.abandon_calls(mark);
+    REQUIRE(memo.pending() == mark);
+    REQUIRE(!memo.find(call_of("h", 1), result));
+}
+
+TEST_CASE( "Test interpreter memoizes calls to pure lambdas", "[memo]" ) {
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+
+        Interpreter interp;
+        interp.setEvaluationMode(mode);
+        REQUIRE(interp.getMemoCache() == nullptr);
+        interp.setMemoCapacity(100);
+
+        auto run = [&interp](const std::string & program){
+            std::istringstream iss(program);
+            REQUIRE(interp.parseStream(iss));
+            return interp.evaluate();
+        };
+
+        run("(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))");
+        REQUIRE(run("(fib 25)") == Expression(75025.));
+
+        // without the cache this takes hundreds of thousands of calls
+        const MemoCache * memo = interp.getMemoCache();
+        REQUIRE(memo->misses() == 26);
+        REQUIRE(memo->hits() == 23);
+
+        REQUIRE(run("(fib 25)") == Expression(75025.));
+        REQUIRE(memo->hits() == 24);
+
+        // apply and map use the cache too
+        REQUIRE(run("(apply fib (list 10))") == Expression(55.));
+        REQUIRE(memo->misses() == 26);
+        REQUIRE(run("(map fib (list 1 2))") == Expression(std::vector<double>{1, 1}));
+
+        // lambdas with side effects are not cached
+        run("(define count (lambda (n) (begin (define calls n) n)))");
+        std::size_t misses = memo->misses();
+        run("(count 1)");
+        REQUIRE(memo->misses() == misses);
+
+        // redefining a procedure clears the results of calls that used it
+        run("(define double (lambda (x) (* 2 x)))");
+        run("(define quad (lambda (x) (double (double x))))");
+        REQUIRE(run("(quad 1)") == Expression(4.));
+        run("(define double (lambda (x) (* 3 x)))");
+        REQUIRE(run("(quad 1)") == Expression(9.));
+
+        // an error leaves no result behind
+        run("(define safe (lambda (x) (first x)))");
+        std::istringstream iss("(safe (list))");
+        REQUIRE(interp.parseStream(iss));
+        REQUIRE_THROWS(interp.evaluate());
+        REQUIRE(run("(safe (list 3))") == Expression(3.));
+
+        interp.setMemoCapacity(0);
+        REQUIRE(interp.getMemoCache() == nullptr);
+    }
+}
@@ -25,8 +25,8 @@ private slots:
     void changeOutput();
     
 signals:
-    void outputChanged(Expression result);
-    void outputChangedError(Expression result);
+    void outputChanged(const Expression & result);
+    void outputChangedError(const Expression & result);
     
 public:
     
@@ -23,7 +23,7 @@ OutputWidget::OutputWidget(QWidget * parent){
     outputList = false;
 }
 
-void OutputWidget::updateOutput(Expression result){
+void OutputWidget::updateOutput(const Expression & result){
     
     if (!outputList){
         scene->clear();
@@ -56,8 +56,8 @@ void OutputWidget::updateOutput(Expression result){
         // Do nothing
     } else if (result.isHeadList()) {
         outputList = true;
-        for(auto e = result.tailConstBegin(); e != result.tailConstEnd(); ++e){
-            updateOutput(*e);
+        for(std::size_t i = 0; i < static_cast<std::size_t>(result.tailSize()); ++i){
+            updateOutput(result.tailAt(i));
         }
         outputList = false;
     }
@@ -65,7 +65,7 @@ void OutputWidget::updateOutput(Expression result){
     view->fitInView(scene->itemsBoundingRect(), Qt::KeepAspectRatio);
 }
 
-void OutputWidget::updateOutputError(Expression result){
+void OutputWidget::updateOutputError(const Expression & result){
     scene->clear();
     
     std::stringstream resultString;
@@ -77,7 +77,7 @@ void OutputWidget::updateOutputError(Expression result){
     
 }
 
-void OutputWidget::createDiscretePlot(Expression result){
+void OutputWidget::createDiscretePlot(const Expression & result){
     
     Expression title = result.get_property(Expression(Atom("\"title\"")));
     Expression absLabel = result.get_property(Expression(Atom("\"abscissa-label\"")));
@@ -136,7 +136,7 @@ void OutputWidget::createDiscretePlot(Expression result){
     double minXVal = __DBL_MAX__;
     double minYVal = __DBL_MAX__;
     for (Expression::ConstIteratorType i = result.tailConstBegin(); i != result.tailConstEnd(); i++){
-        Expression point = *i;
+        const Expression & point = *i;
         
         if (point.tail()[-1].head().asNumber() > maxXVal){
             maxXVal = point.tail()[-1].head().asNumber();
@@ -270,7 +270,7 @@ void OutputWidget::createDiscretePlot(Expression result){
     
     // Add points
     for (Expression::ConstIteratorType i = result.tailConstBegin(); i != result.tailConstEnd(); i++){
-        Expression point = *i;
+        const Expression & point = *i;
         Expression newPoint;
         newPoint.add_property(Expression(Atom("\"size\"")), Expression(Atom(P)));
         newPoint.add_property(Expression(Atom("\"object-name\"")), Expression(Atom("\"point\"")));
@@ -323,7 +323,7 @@ void OutputWidget::createDiscretePlot(Expression result){
     
 }
 
-void OutputWidget::createContinuousPlot(Expression result){
+void OutputWidget::createContinuousPlot(const Expression & result){
     
     // I'm dumb rip
     
@@ -383,12 +383,13 @@ void OutputWidget::createContinuousPlot(Expression result){
     double maxYVal = 0;
     double minXVal = 0;
     double minYVal = 0;
-    for (Expression::ConstIteratorType i = result.tailConstBegin(); i != result.tailConstEnd(); i++){
-        if (i->isHeadNumber()){
-            if (i->head().asNumber() < minXVal){
-                minXVal = i->head().asNumber();
+    for (std::size_t i = 0; i < static_cast<std::size_t>(result.tailSize()); i++){
+        Expression bound = result.tailAt(i);
+        if (bound.isHeadNumber()){
+            if (bound.head().asNumber() < minXVal){
+                minXVal = bound.head().asNumber();
             } else {
-                maxXVal = i->head().asNumber();
+                maxXVal = bound.head().asNumber();
             }
         }
     }
@@ -513,7 +514,7 @@ void OutputWidget::createContinuousPlot(Expression result){
     
 }
 
-void OutputWidget::outputResult(Expression result){
+void OutputWidget::outputResult(const Expression & result){
     
     std::stringstream resultString;
     
@@ -530,7 +531,7 @@ void OutputWidget::outputResult(Expression result){
     
 }
 
-void OutputWidget::outputText(Expression result){
+void OutputWidget::outputText(const Expression & result){
     
     // Create text
     std::stringstream resultString;
@@ -574,7 +575,7 @@ void OutputWidget::outputText(Expression result){
     
 }
 
-void OutputWidget::outputLine(Expression result){
+void OutputWidget::outputLine(const Expression & result){
     
     // Create line
     bool error = false;
@@ -615,7 +616,7 @@ void OutputWidget::outputLine(Expression result){
     }
 }
 
-void OutputWidget::outputPoint(Expression result){
+void OutputWidget::outputPoint(const Expression & result){
     
     // Create Point
     double size = result.get_property(Expression(Atom("\"size\""))).head().asNumber();
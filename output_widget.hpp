@@ -26,18 +26,18 @@ private:
     QPen * myPen;
     bool outputList;
     
-    void createDiscretePlot(Expression result);
-    void createContinuousPlot(Expression result);
-    void outputResult(Expression result);
-    void outputText(Expression result);
-    void outputLine(Expression result);
-    void outputPoint(Expression result);
+    void createDiscretePlot(const Expression & result);
+    void createContinuousPlot(const Expression & result);
+    void outputResult(const Expression & result);
+    void outputText(const Expression & result);
+    void outputLine(const Expression & result);
+    void outputPoint(const Expression & result);
     void outputBoundingPlot(double botRightX, double botRightY, double topLeftX, double topLeftY);
     
 public slots:
     
-    void updateOutput(Expression result);
-    void updateOutputError(Expression result);
+    void updateOutput(const Expression & result);
+    void updateOutputError(const Expression & result);
     
     
 };
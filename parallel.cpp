@@ -0,0 +1,227 @@
+#include "parallel.hpp"
+
+// system includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+// module includes
+#include "semantic_error.hpp"
+#include "vm.hpp"
+
+// tasks parallel_map splits a list into per worker, so that workers finishing
+// early have work left to steal
+const std::size_t CHUNKS_PER_WORKER = 4;
+
+ThreadPool::ThreadPool(std::size_t workers): pending(0), stopping(false){
+
+    std::size_t n = std::max<std::size_t>(workers, 1);
+
+    for(std::size_t i = 0; i < n; ++i){
+        queues.emplace_back(new Queue);
+    }
+
+    for(std::size_t i = 0; i < n; ++i){
+        this->workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+
+    for(auto & worker : workers){
+        worker.join();
+    }
+}
+
+ThreadPool & ThreadPool::instance(){
+
+    // initialization of a local static is thread-safe
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+std::size_t ThreadPool::size() const noexcept{
+
+    return queues.size();
+}
+
+void ThreadPool::run(std::vector<Task> tasks){
+
+    if(tasks.empty()){
+        return;
+    }
+
+    // tracks the tasks of this call, and outlives the call if need be
+    struct Group {
+        std::atomic<std::size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    std::shared_ptr<Group> group = std::make_shared<Group>();
+    group->remaining = tasks.size();
+
+    // counted before they are queued, so a worker never takes more than pending
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        pending += tasks.size();
+    }
+
+    for(std::size_t i = 0; i < tasks.size(); ++i){
+        Task task = std::move(tasks[i]);
+        Task wrapped = [group, task](){
+            task();
+            if(--group->remaining == 0){
+                std::lock_guard<std::mutex> lock(group->mutex);
+                group->done.notify_all();
+            }
+        };
+
+        Queue & queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(wrapped));
+    }
+    wakeup.notify_all();
+
+    // help rather than block, so nested calls cannot deadlock the pool
+    Task task;
+    while(group->remaining > 0){
+        if(take(0, task)){
+            task();
+            task = nullptr;
+        }
+        else{
+            std::unique_lock<std::mutex> lock(group->mutex);
+            group->done.wait_for(lock, std::chrono::milliseconds(1), [&group](){
+                return group->remaining == 0;
+            });
+        }
+    }
+}
+
+bool ThreadPool::take(std::size_t index, Task & task){
+
+    bool found = false;
+
+    for(std::size_t k = 0; k < queues.size() && !found; ++k){
+        Queue & queue = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.tasks.empty()){
+            if(k == 0){
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else{
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            found = true;
+        }
+    }
+
+    if(found){
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        --pending;
+    }
+
+    return found;
+}
+
+void ThreadPool::work(std::size_t index){
+
+    Task task;
+
+    while(true){
+        if(take(index, task)){
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wakeup.wait(lock, [this](){ return stopping || pending > 0; });
+        if(stopping && pending == 0){
+            return;
+        }
+    }
+}
+
+Expression parallel_map(const Atom & op, const Expression & list, Environment & env){
+
+    if(!list.isHeadList()){
+        throw SemanticError("Error: second argument to pmap not a list");
+    }
+
+    // the definitions made in the copies of env would be lost
+    if(env.get_purity(op) == Environment::WritesGlobals){
+        VirtualMachine vm;
+        std::vector<Expression> args(1);
+
+        Expression result(Atom("list"));
+        for(std::size_t i = 0; i < static_cast<std::size_t>(list.tailSize()); ++i){
+            args[0] = list.tailAt(i);
+            result.append(vm.apply(op, args, env));
+        }
+        return result;
+    }
+
+    ThreadPool & pool = ThreadPool::instance();
+
+    std::size_t n = list.tailSize();
+    std::size_t chunks = std::min(n, pool.size() * CHUNKS_PER_WORKER);
+
+    std::vector<Expression> results(n);
+
+    // the first element (in list order) known to fail, and its error. Chunks
+    // skip the elements after it, as the sequential map would never get there.
+    std::mutex error_mutex;
+    std::atomic<std::size_t> failed(n);
+    std::exception_ptr error;
+
+    std::vector<ThreadPool::Task> tasks;
+    for(std::size_t c = 0; c < chunks; ++c){
+        std::size_t begin = n * c / chunks;
+        std::size_t end = n * (c + 1) / chunks;
+
+        tasks.push_back([&, begin, end](){
+            std::size_t i = begin;
+            try{
+                Environment local(env);
+                VirtualMachine vm;
+                std::vector<Expression> args;
+
+                for(; i < end && i < failed; ++i){
+                    args.clear();
+                    args.push_back(list.tailAt(i));
+                    results[i] = vm.apply(op, args, local);
+                }
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(i < failed){
+                    failed = i;
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+
+    pool.run(std::move(tasks));
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+
+    Expression result(Atom("list"));
+    for(auto & r : results){
+        result.append(std::move(r));
+    }
+
+    return result;
+}
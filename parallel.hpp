@@ -0,0 +1,104 @@
+/*! \file parallel.hpp
+ Defines the thread pool used for parallel evaluation and parallel_map, which
+ implements the pmap special-form.
+ */
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+// system includes
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// module includes
+#include "atom.hpp"
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \class ThreadPool
+ \brief A fixed set of worker threads that balance load by work stealing.
+
+ Each worker has its own double-ended queue of tasks. It takes tasks from the
+ back of its own queue and, once that is empty, steals from the front of the
+ queues of the others, so a worker that finishes early takes over the work
+ left to slower ones.
+
+ A thread waiting in run for its tasks runs queued tasks itself rather than
+ blocking, so a task may call run in turn (e.g. a pmap nested in the
+ procedure of another) without deadlocking the pool.
+ */
+class ThreadPool {
+public:
+
+    typedef std::function<void()> Task;
+
+    /// construct a pool with the given number of workers, at least one
+    explicit ThreadPool(std::size_t workers);
+
+    /// stop and join the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    /// return the process-wide pool, with a worker per hardware thread
+    static ThreadPool & instance();
+
+    /// return the number of workers
+    std::size_t size() const noexcept;
+
+    /*! Run tasks in parallel, returning once all of them have finished.
+     \param tasks the tasks to run, which must not throw
+     */
+    void run(std::vector<Task> tasks);
+
+private:
+
+    // the task queue of a worker
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    // idle workers wait on wakeup for tasks to be queued or the pool to stop
+    std::mutex sleep_mutex;
+    std::condition_variable wakeup;
+
+    // number of queued tasks and whether the pool is stopping, guarded by
+    // sleep_mutex
+    std::size_t pending;
+    bool stopping;
+
+    // take a task from the back of queue index or else from the front of
+    // another queue, returns false if all queues are empty
+    bool take(std::size_t index, Task & task);
+
+    // the loop of the worker owning queue index
+    void work(std::size_t index);
+};
+
+/*! \fn parallel_map
+ \brief call a procedure on each element of a list, in parallel
+
+ The list is split into chunks run as tasks of the ThreadPool. Each task
+ evaluates in its own copy of env, so the procedure must not define
+ anything: one that may (see Environment::get_purity) is instead called on
+ the elements in order, in env, like the sequential map.
+
+ \param op the symbol naming the procedure, which takes one argument
+ \param list the list to map over
+ \param env the environment to evaluate in
+ \return the list of results, in the order of the elements of list
+ \throws SemanticError if list is not a list, or the error the first element
+ (in list order) to fail raised, as the sequential map would
+ */
+Expression parallel_map(const Atom & op, const Expression & list, Environment & env);
+
+#endif
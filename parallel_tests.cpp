@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <vector>
+
+#include "parallel.hpp"
+#include "semantic_error.hpp"
+
+TEST_CASE( "Test thread pool runs every task", "[parallel]" ) {
+
+    ThreadPool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    std::vector<int> done(1000, 0);
+    std::vector<ThreadPool::Task> tasks;
+    for(std::size_t i = 0; i < done.size(); ++i){
+        tasks.push_back([&done, i](){ done[i] += 1; });
+    }
+
+    pool.run(std::move(tasks));
+
+    for(int d : done){
+        REQUIRE(d == 1);
+    }
+
+    // the pool can be reused, and an empty run returns at once
+    pool.run(std::vector<ThreadPool::Task>());
+}
+
+TEST_CASE( "Test thread pool runs nested tasks", "[parallel]" ) {
+
+    // a single worker, so the nested runs are helped along by their callers
+    ThreadPool pool(1);
+    std::atomic<int> count(0);
+
+    std::vector<ThreadPool::Task> outer;
+    for(int i = 0; i < 8; ++i){
+        outer.push_back([&pool, &count](){
+            std::vector<ThreadPool::Task> inner;
+            for(int j = 0; j < 8; ++j){
+                inner.push_back([&count](){ ++count; });
+            }
+            pool.run(std::move(inner));
+        });
+    }
+
+    pool.run(std::move(outer));
+
+    REQUIRE(count == 64);
+}
+
+TEST_CASE( "Test parallel map", "[parallel]" ) {
+
+    Environment env;
+
+    Expression list(std::vector<double>{1, 4, 9, 16});
+    Expression result = parallel_map(Atom("sqrt"), list, env);
+
+    Expression expected(std::vector<double>{1, 2, 3, 4});
+    REQUIRE(result == expected);
+
+    REQUIRE(parallel_map(Atom("sqrt"), Expression(Atom("list")), env) == Expression(Atom("list")));
+
+    REQUIRE_THROWS_AS(parallel_map(Atom("sqrt"), Expression(1.), env), const SemanticError &);
+}
@@ -2,6 +2,8 @@
 
 #include <stack>
 
+#include "hashcons.hpp"
+
 bool setHead(Expression &exp, const Token &token) {
     
     Atom a(token);
@@ -20,7 +22,7 @@ bool append(Expression *exp, const Token &token) {
     return !a.isNone();
 }
 
-Expression parse(const TokenSequenceType &tokens) noexcept {
+Expression parse(const TokenSequenceType &tokens) {
     
     Expression ast;
     
@@ -82,7 +84,7 @@ Expression parse(const TokenSequenceType &tokens) noexcept {
     }
     
     if (stack.empty() && (num_tokens_seen == tokens.size())) {
-        return ast;
+        return share(ast);
     }
     
     return Expression();
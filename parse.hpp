@@ -10,9 +10,14 @@
 /*! \fn parse
  \brief parse a sequence of tokens into an expression (abstract syntax tree)
  
+ Identical subtrees of the result share their storage if hash-consing is
+ enabled (see HashCons).
+ 
  \param tokens, the input token sequence
  \returns the expression resulting from parsing or the None Expression on failure
+ \throws SemanticError if the symbol table is full, std::bad_alloc if memory
+ runs out
  */
-Expression parse(const TokenSequenceType & tokens) noexcept;
+Expression parse(const TokenSequenceType & tokens);
 
 #endif
@@ -7,8 +7,10 @@
 #include <chrono>
 
 #include "interpreter.hpp"
+#include "mapped_file.hpp"
 #include "semantic_error.hpp"
 #include "startup_config.hpp"
+#include "token.hpp"
 
 struct Message {
     Expression expression;
@@ -35,33 +37,108 @@ void info(const std::string & err_str){
     std::cout << "Info: " << err_str << std::endl;
 }
 
-int eval_from_stream(std::istream & stream){
-    
-    Interpreter interp;
+// read the text of the startup file, returns false if it can not be opened
+bool read_startup(std::string & text){
     
     std::ifstream startup_stream(STARTUP_FILE);
     
     if(!startup_stream){
-        error("Could not open startup file for reading.");
+        return false;
     }
     
-    if(!interp.parseStream(startup_stream)){
-        error("Invalid Program. Could not parse start up file.");
+    std::ostringstream contents;
+    contents << startup_stream.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+// parse and evaluate the startup program, returns the error to report or an
+// empty string
+std::string evaluate_program(Interpreter & interp, const std::string & text){
+    
+    std::istringstream program(text);
+    
+    if(!interp.parseStream(program)){
+        return "Error: Invalid Program. Could not parse start up file.";
     }
-    else{
-        try{
-            Expression exp = interp.evaluate();
-        }
-        catch(const SemanticError & ex){
-            std::cerr << ex.what() << std::endl;
-        }
+    
+    try{
+        interp.evaluate();
+    }
+    catch(const SemanticError & ex){
+        return ex.what();
     }
     
-    if(!interp.parseStream(stream)){
-        error("Invalid Program. Could not parse.");
+    return "";
+}
+
+// make the definitions of the startup file, from the image the build saved of
+// them unless the file has changed since, returns the error to report or an
+// empty string
+std::string evaluate_startup(Interpreter & interp){
+    
+    std::string text;
+    if(!read_startup(text)){
+        return "Error: Could not open startup file for reading.";
+    }
+    
+    std::ifstream image_stream(STARTUP_IMAGE, std::ios::binary);
+    if(image_stream && interp.loadImage(image_stream, text)){
+        return "";
+    }
+    
+    return evaluate_program(interp, text);
+}
+
+// evaluate the startup file and save its definitions as an image
+int save_startup_image(const std::string & filename){
+    
+    Interpreter interp;
+    
+    std::string text;
+    if(!read_startup(text)){
+        error("Could not open startup file for reading.");
         return EXIT_FAILURE;
     }
-    else{
+    
+    std::string err = evaluate_program(interp, text);
+    if(!err.empty()){
+        std::cerr << err << std::endl;
+        return EXIT_FAILURE;
+    }
+    
+    std::ofstream image_stream(filename, std::ios::binary);
+    if(!image_stream || !interp.saveImage(image_stream, text)){
+        error("Could not save startup image.");
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+int eval_from_reader(FormReader & reader){
+    
+    Interpreter interp;
+    
+    std::string err = evaluate_startup(interp);
+    if(!err.empty()){
+        std::cerr << err << std::endl;
+    }
+    
+    // evaluate the program form by form, printing each result as it is
+    // computed, so only the current form is held in memory
+    const char * first;
+    const char * last;
+    bool empty = true;
+    
+    while(reader.next(first, last)){
+        empty = false;
+        
+        if(!interp.parseBuffer(first, last - first)){
+            error("Invalid Program. Could not parse.");
+            return EXIT_FAILURE;
+        }
+        
         try{
             Expression exp = interp.evaluate();
             std::cout << exp << std::endl;
@@ -72,19 +149,34 @@ int eval_from_stream(std::istream & stream){
         }
     }
     
+    if(empty){
+        error("Invalid Program. Could not parse.");
+        return EXIT_FAILURE;
+    }
+    
     return EXIT_SUCCESS;
 }
 
+int eval_from_stream(std::istream & stream){
+    
+    FormReader reader(stream);
+    
+    return eval_from_reader(reader);
+}
+
 int eval_from_file(std::string filename){
     
-    std::ifstream ifs(filename);
+    // the forms are tokenized where the file is mapped, without copying it
+    MappedFile file(filename);
     
-    if(!ifs){
+    if(!file.is_open()){
         error("Could not open file for reading.");
         return EXIT_FAILURE;
     }
     
-    return eval_from_stream(ifs);
+    FormReader reader(file.data(), file.data() + file.size());
+    
+    return eval_from_reader(reader);
 }
 
 int eval_from_command(std::string argexp){
@@ -94,36 +186,18 @@ int eval_from_command(std::string argexp){
     return eval_from_stream(expression);
 }
 
-void interpret(MessageQueue<std::string> & inputQueue, MessageQueue<Message> & outputQueue, std::atomic_bool & runInterpreter, Interpreter * interp){
-    
-    // Interpreter interp;
-    
-    Message outputMsg;
+// make the definitions of the startup file, reporting errors as they are found
+void startup(Interpreter & interp){
     
-    std::ifstream startup_stream(STARTUP_FILE);
-    
-    if(!startup_stream){
-        outputMsg.isError = true;
-        outputMsg.errorMsg = "Could not open startup file for reading.";
-        outputQueue.push(outputMsg);
+    std::string err = evaluate_startup(interp);
+    if(!err.empty()){
+        std::cerr << err << std::endl;
     }
+}
+
+void interpret(MessageQueue<std::string> & inputQueue, MessageQueue<Message> & outputQueue, std::atomic_bool & runInterpreter, Interpreter * interp){
     
-    if(!(*interp).parseStream(startup_stream)){
-        outputMsg.isError = true;
-        outputMsg.errorMsg = "Invalid Program. Could not parse start up file.";
-        outputQueue.push(outputMsg);
-    }
-    else{
-        try{
-            Expression exp = (*interp).evaluate();
-            outputMsg.isError = false;
-        }
-        catch(const SemanticError & ex){
-            outputMsg.isError = true;
-            outputQueue.push(outputMsg);
-            std::cerr << ex.what() << std::endl;
-        }
-    }
+    Message outputMsg;
     
     while (runInterpreter){
         
@@ -140,10 +214,10 @@ void interpret(MessageQueue<std::string> & inputQueue, MessageQueue<Message> & o
             }
             else{
                 try{
-                    Expression exp = (*interp).evaluate(); // Output created
+                    outputMsg.expression = (*interp).evaluate(); // Output created
                     outputMsg.isError = false;
-                    outputMsg.expression = exp;
-                    outputQueue.push(outputMsg);
+                    outputMsg.errorMsg.clear();
+                    outputQueue.push(std::move(outputMsg));
                 }
                 catch(const SemanticError & ex){
                     outputMsg.isError = true;
@@ -166,6 +240,10 @@ int repl(){
     
     Interpreter interp;
     
+    // the state after startup, which %reset returns to
+    startup(interp);
+    const Environment base = interp.snapshot();
+    
     runInterpreter = true;
     
     std::thread interpretThread(interpret, std::ref(inputQueue), std::ref(outputQueue), std::ref(runInterpreter), &interp);
@@ -182,35 +260,27 @@ int repl(){
             if (interpretThread.joinable()){
                 interpretThread.join();
             }
-            interpretThread.~thread();
             continue;
         }
         
         if (!runInterpreter && line == "%start"){
-            std::thread interpretThread(interpret, std::ref(inputQueue), std::ref(outputQueue), std::ref(runInterpreter), &interp);
             runInterpreter = true;
-            if (interpretThread.joinable()){
-                interpretThread.detach();
-            }
+            interpretThread = std::thread(interpret, std::ref(inputQueue), std::ref(outputQueue), std::ref(runInterpreter), &interp);
             continue;
         }
         
         if (line == "%reset"){
-            // Stop the thread
+            // Stop the thread, which must be done with interp before it is restored
             runInterpreter = false;
             if (interpretThread.joinable()){
                 interpretThread.join();
             }
-            interpretThread.~thread();
             
-            Interpreter * newInterp = new Interpreter();
+            interp.restore(base);
             
             // Start the thread
-            std::thread interpretThread(interpret, std::ref(inputQueue), std::ref(outputQueue), std::ref(runInterpreter), newInterp);
             runInterpreter = true;
-            if (interpretThread.joinable()){
-                interpretThread.detach();
-            }
+            interpretThread = std::thread(interpret, std::ref(inputQueue), std::ref(outputQueue), std::ref(runInterpreter), &interp);
             continue;
         }
         
@@ -219,7 +289,6 @@ int repl(){
             if (interpretThread.joinable()){
                 interpretThread.join();
             }
-            interpretThread.~thread();
             return EXIT_SUCCESS;
         }
         
@@ -232,9 +301,7 @@ int repl(){
             outputQueue.wait_and_pop(outputMsg);
             
             if (!outputMsg.isError){
-                Expression exp = outputMsg.expression;
-                
-                std::cout << exp << std::endl;
+                std::cout << outputMsg.expression << std::endl;
             } else {
                 outputMsg.isError = false;
                 if (outputMsg.errorMsg != ""){
@@ -262,6 +329,9 @@ int main(int argc, char *argv[])
         if(std::string(argv[1]) == "-e"){
             return eval_from_command(argv[2]);
         }
+        else if(std::string(argv[1]) == "--image"){
+            return save_startup_image(argv[2]);
+        }
         else{
             error("Incorrect number of command line arguments.");
         }
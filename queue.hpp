@@ -4,6 +4,7 @@
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 #include "expression.hpp"
 
 template<typename T>
@@ -18,6 +19,14 @@ public:
         the_condition_variable.notify_one();
     }
     
+    // Moves the value into the queue
+    void push(T && value){
+        std::unique_lock<std::mutex> lock(the_mutex);
+        the_queue.push(std::move(value));
+        lock.unlock();
+        the_condition_variable.notify_one();
+    }
+    
     // Checks if queue is empty
     bool empty(){
         std::lock_guard<std::mutex> lock(the_mutex);
@@ -31,7 +40,7 @@ public:
             return false;
         }
         
-        popped_value = the_queue.front();
+        popped_value = std::move(the_queue.front());
         the_queue.pop();
         return true;
     }
@@ -44,7 +53,7 @@ public:
             the_condition_variable.wait(lock);
         }
         
-        popped_value = the_queue.front();
+        popped_value = std::move(the_queue.front());
         the_queue.pop();
     }
     
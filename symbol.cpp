@@ -0,0 +1,76 @@
+#include "symbol.hpp"
+
+// module includes
+#include "semantic_error.hpp"
+
+SymbolTable::SymbolTable(){
+
+    // must match the order of WellKnown
+    intern("list");
+    intern("lambda");
+    intern("begin");
+    intern("if");
+    intern("define");
+    intern("apply");
+    intern("map");
+    intern("pmap");
+    intern("range");
+    intern("continuous-plot");
+}
+
+SymbolTable & SymbolTable::instance(){
+
+    // initialization of a local static is thread-safe
+    static SymbolTable table;
+    return table;
+}
+
+SymbolId SymbolTable::intern(const std::string & name){
+
+    std::lock_guard<std::mutex> lock(the_mutex);
+
+    auto search = ids.find(name);
+    if(search != ids.end()){
+        return search->second;
+    }
+
+    std::size_t id = ids.size();
+    std::size_t block = id >> BLOCK_BITS;
+
+    if(block >= MAX_BLOCKS){
+        throw SemanticError("Error: too many symbols");
+    }
+
+    if(!blocks[block]){
+        blocks[block].reset(new std::string[BLOCK_SIZE]);
+    }
+
+    blocks[block][id & (BLOCK_SIZE - 1)] = name;
+    ids.emplace(name, id);
+
+    return id;
+}
+
+bool SymbolTable::find(const std::string & name, SymbolId & id) const{
+
+    std::lock_guard<std::mutex> lock(the_mutex);
+
+    auto search = ids.find(name);
+    if(search == ids.end()){
+        return false;
+    }
+
+    id = search->second;
+    return true;
+}
+
+const std::string & SymbolTable::name(SymbolId id) const noexcept{
+
+    return blocks[id >> BLOCK_BITS][id & (BLOCK_SIZE - 1)];
+}
+
+std::size_t SymbolTable::size() const{
+
+    std::lock_guard<std::mutex> lock(the_mutex);
+    return ids.size();
+}
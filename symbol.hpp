@@ -0,0 +1,94 @@
+/*! \file symbol.hpp
+ Defines the global symbol table used to intern symbol names.
+
+ Interning maps every distinct symbol name to a small integer id, once. Atoms
+ of symbol type carry only the id, so comparing two symbols or looking one up
+ in the Environment is an integer operation rather than a string comparison.
+ */
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+// system includes
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*! \typedef SymbolId
+ \brief The interned id of a symbol name.
+ */
+typedef std::uint32_t SymbolId;
+
+/*! \class SymbolTable
+ \brief A process-wide, thread-safe table of interned symbol names.
+
+ Ids are never reused or invalidated, so a name returned by the table stays
+ valid for the life of the program. Interning takes a lock; looking up the
+ name of an id does not.
+ */
+class SymbolTable {
+public:
+
+    /*! \enum WellKnown
+     \brief ids of symbols interned when the table is created, so they can be
+     compared against without a lookup. The special-forms are among them, so
+     evaluation can dispatch on the id of a head with a switch.
+     */
+    enum WellKnown : SymbolId { LIST = 0, //< "list"
+        LAMBDA,         //< "lambda"
+        BEGIN,          //< "begin"
+        IF,             //< "if"
+        DEFINE,         //< "define"
+        APPLY,          //< "apply"
+        MAP,            //< "map"
+        PMAP,           //< "pmap"
+        RANGE,          //< "range"
+        CONTINUOUS_PLOT //< "continuous-plot"
+    };
+
+    /// return the process-wide symbol table
+    static SymbolTable & instance();
+
+    /*! Intern a symbol name.
+     \param name the name to intern
+     \return the id of name, the same id for every call with an equal name
+     \throws SemanticError if the table is full
+     */
+    SymbolId intern(const std::string & name);
+
+    /*! Find the id of a symbol name without interning it.
+     \param name the name to find
+     \param id set to the id of name, if it was interned
+     \return false if name was never interned
+     */
+    bool find(const std::string & name, SymbolId & id) const;
+
+    /*! Get the name of an interned symbol.
+     \param id an id previously returned by intern
+     \return the name the id was interned for
+     */
+    const std::string & name(SymbolId id) const noexcept;
+
+    /// return the number of interned symbols
+    std::size_t size() const;
+
+private:
+
+    SymbolTable();
+
+    // names are stored in fixed-size blocks that are never moved, so readers
+    // can index them without taking the lock
+    static const std::size_t BLOCK_BITS = 10;
+    static const std::size_t BLOCK_SIZE = std::size_t(1) << BLOCK_BITS;
+    static const std::size_t MAX_BLOCKS = 4096;
+
+    std::unique_ptr<std::string[]> blocks[MAX_BLOCKS];
+
+    // name to id map, used only when interning and finding
+    std::unordered_map<std::string, SymbolId> ids;
+
+    mutable std::mutex the_mutex;
+};
+
+#endif
@@ -0,0 +1,220 @@
+/*! \file symbol_map.hpp
+ Defines a hash map keyed by interned symbol id, used by the environment.
+ */
+#ifndef SYMBOL_MAP_HPP
+#define SYMBOL_MAP_HPP
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// module includes
+#include "symbol.hpp"
+
+/*! \class SymbolMap
+ \brief A map from SymbolId to Value, stored by open addressing.
+
+ The entries live in a single array with linear probing, so a lookup is a
+ multiplication and, usually, one comparison. The array is kept at most half
+ full and doubles when needed. Removal shifts the entries after the removed
+ one back instead of leaving tombstones, so lookups never slow down.
+
+ Inserting or removing may move the entries: pointers and iterators into the
+ map are valid only until the next change.
+ */
+template<typename Value>
+class SymbolMap {
+public:
+
+    /// an entry: the key and the value it maps to
+    typedef std::pair<SymbolId, Value> Entry;
+
+private:
+
+    // the key of an unused slot, never returned by the SymbolTable in practice
+    static const SymbolId EMPTY = std::numeric_limits<SymbolId>::max();
+
+    // iterates over the used slots of a map, E is Entry or const Entry
+    template<typename E>
+    class Iterator {
+    public:
+        Iterator(E * slot, E * last): current(slot), end(last){
+            skip();
+        }
+        E & operator*() const{
+            return *current;
+        }
+        E * operator->() const{
+            return current;
+        }
+        Iterator & operator++(){
+            ++current;
+            skip();
+            return *this;
+        }
+        bool operator!=(const Iterator & other) const{
+            return current != other.current;
+        }
+    private:
+        void skip(){
+            while(current != end && current->first == EMPTY){
+                ++current;
+            }
+        }
+        E * current;
+        E * end;
+    };
+
+public:
+
+    typedef Iterator<Entry> iterator;
+    typedef Iterator<const Entry> const_iterator;
+
+    /// construct an empty map
+    SymbolMap(): slots(MIN_CAPACITY, Entry(EMPTY, Value())), count(0), shift(MIN_SHIFT){}
+
+    /// return a pointer to the value key maps to, nullptr if none
+    Value * find(SymbolId key) noexcept{
+        std::size_t i = locate(key);
+        return (slots[i].first == key) ? &slots[i].second : nullptr;
+    }
+
+    /// return a pointer to the value key maps to, nullptr if none
+    const Value * find(SymbolId key) const noexcept{
+        std::size_t i = locate(key);
+        return (slots[i].first == key) ? &slots[i].second : nullptr;
+    }
+
+    /// map key to value, replacing any value it mapped to, and return the stored value
+    Value & insert(SymbolId key, Value value){
+        if(2 * (count + 1) > slots.size()){
+            grow();
+        }
+        std::size_t i = locate(key);
+        if(slots[i].first != key){
+            slots[i].first = key;
+            ++count;
+        }
+        slots[i].second = std::move(value);
+        return slots[i].second;
+    }
+
+    /// remove the entry for key, return false if there was none
+    bool erase(SymbolId key){
+        std::size_t i = locate(key);
+        if(slots[i].first != key){
+            return false;
+        }
+        release(i);
+        --count;
+
+        // move back the entries of the probe sequence that follows, unless
+        // their home slot lies between the hole and their position
+        std::size_t mask = slots.size() - 1;
+        for(std::size_t j = (i + 1) & mask; slots[j].first != EMPTY; j = (j + 1) & mask){
+            std::size_t home = slot_of(slots[j].first);
+            bool stays = (i < j) ? (i < home && home <= j) : (i < home || home <= j);
+            if(!stays){
+                slots[i] = std::move(slots[j]);
+                release(j);
+                i = j;
+            }
+        }
+        return true;
+    }
+
+    /// remove all entries
+    void clear(){
+        for(std::size_t i = 0; i < slots.size(); ++i){
+            if(slots[i].first != EMPTY){
+                release(i);
+            }
+        }
+        count = 0;
+    }
+
+    /// return the number of entries
+    std::size_t size() const noexcept{
+        return count;
+    }
+
+    iterator begin(){
+        return iterator(slots.data(), slots.data() + slots.size());
+    }
+
+    iterator end(){
+        return iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+    const_iterator begin() const{
+        return const_iterator(slots.data(), slots.data() + slots.size());
+    }
+
+    const_iterator end() const{
+        return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+private:
+
+    static const std::size_t MIN_CAPACITY = 64;
+
+    // 64 less the log2 of MIN_CAPACITY
+    static const unsigned MIN_SHIFT = 58;
+
+    // the slots, a power of two of them
+    std::vector<Entry> slots;
+
+    std::size_t count;
+
+    // 64 less the log2 of the number of slots
+    unsigned shift;
+
+    // the first slot probed for key, by Fibonacci hashing of the dense ids:
+    // the top bits of the key times 2^64 divided by the golden ratio, which
+    // spread consecutive ids over the whole array
+    std::size_t slot_of(SymbolId key) const noexcept{
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(key) * 11400714819323198485ull) >> shift);
+    }
+
+    // the slot holding key, or the unused slot ending its probe sequence
+    std::size_t locate(SymbolId key) const noexcept{
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = slot_of(key);
+        while(slots[i].first != key && slots[i].first != EMPTY){
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    // mark slot i unused, releasing its value
+    void release(std::size_t i){
+        slots[i].first = EMPTY;
+        slots[i].second = Value();
+    }
+
+    // double the number of slots, reinserting the entries
+    void grow(){
+        std::vector<Entry> old(2 * slots.size(), Entry(EMPTY, Value()));
+        old.swap(slots);
+        --shift;
+        for(auto & entry : old){
+            if(entry.first != EMPTY){
+                slots[locate(entry.first)] = std::move(entry);
+            }
+        }
+    }
+};
+
+template<typename Value>
+const SymbolId SymbolMap<Value>::EMPTY;
+
+template<typename Value>
+const std::size_t SymbolMap<Value>::MIN_CAPACITY;
+
+template<typename Value>
+const unsigned SymbolMap<Value>::MIN_SHIFT;
+
+#endif
@@ -0,0 +1,75 @@
+#include "catch.hpp"
+
+#include <map>
+#include <random>
+
+#include "symbol_map.hpp"
+
+TEST_CASE( "Test symbol map insert, find and erase", "[symbol_map]" ) {
+
+    SymbolMap<int> map;
+
+    REQUIRE(map.size() == 0);
+    REQUIRE(map.find(1) == nullptr);
+
+    map.insert(1, 10);
+    map.insert(2, 20);
+    REQUIRE(map.size() == 2);
+    REQUIRE(*map.find(1) == 10);
+    REQUIRE(*map.find(2) == 20);
+
+    // inserting an existing key replaces its value
+    map.insert(1, 11);
+    REQUIRE(map.size() == 2);
+    REQUIRE(*map.find(1) == 11);
+
+    REQUIRE(map.erase(1));
+    REQUIRE(!map.erase(1));
+    REQUIRE(map.find(1) == nullptr);
+    REQUIRE(*map.find(2) == 20);
+
+    map.clear();
+    REQUIRE(map.size() == 0);
+    REQUIRE(map.find(2) == nullptr);
+}
+
+TEST_CASE( "Test symbol map agrees with std::map", "[symbol_map]" ) {
+
+    SymbolMap<int> map;
+    std::map<SymbolId, int> expected;
+
+    // keys from a small range collide and probe, and the map grows past its
+    // initial size
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<SymbolId> keys(0, 500);
+
+    for(int i = 0; i < 20000; ++i){
+        SymbolId key = keys(generator);
+        if(i % 3 == 0){
+            REQUIRE(map.erase(key) == (expected.erase(key) == 1));
+        }
+        else{
+            map.insert(key, i);
+            expected[key] = i;
+        }
+    }
+
+    REQUIRE(map.size() == expected.size());
+    for(SymbolId key = 0; key <= 500; ++key){
+        auto it = expected.find(key);
+        if(it == expected.end()){
+            REQUIRE(map.find(key) == nullptr);
+        }
+        else{
+            REQUIRE(map.find(key) != nullptr);
+            REQUIRE(*map.find(key) == it->second);
+        }
+    }
+
+    std::size_t visited = 0;
+    for(const auto & entry : map){
+        REQUIRE(expected.at(entry.first) == entry.second);
+        ++visited;
+    }
+    REQUIRE(visited == expected.size());
+}
@@ -0,0 +1,72 @@
+#include "catch.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "symbol.hpp"
+#include "atom.hpp"
+
+TEST_CASE( "Test interning", "[symbol]" ) {
+    
+    SymbolTable & table = SymbolTable::instance();
+    
+    SymbolId a = table.intern("interned-a");
+    SymbolId b = table.intern("interned-b");
+    
+    REQUIRE(a != b);
+    REQUIRE(table.intern("interned-a") == a);
+    REQUIRE(table.name(a) == "interned-a");
+    REQUIRE(table.name(b) == "interned-b");
+    
+    REQUIRE(table.intern("list") == SymbolTable::LIST);
+    REQUIRE(table.intern("lambda") == SymbolTable::LAMBDA);
+    REQUIRE(table.intern("begin") == SymbolTable::BEGIN);
+    REQUIRE(table.intern("continuous-plot") == SymbolTable::CONTINUOUS_PLOT);
+    
+    SymbolId found;
+    REQUIRE(table.find("interned-a", found));
+    REQUIRE(found == a);
+    
+    std::size_t size = table.size();
+    REQUIRE(!table.find("never-interned", found));
+    REQUIRE(table.size() == size);
+}
+
+TEST_CASE( "Test symbol Atoms carry interned ids", "[symbol]" ) {
+    
+    Atom a("foo");
+    Atom b(Token("foo"));
+    Atom c("bar");
+    
+    REQUIRE(a.asSymbolId() == b.asSymbolId());
+    REQUIRE(a.asSymbolId() != c.asSymbolId());
+    REQUIRE(a == b);
+    REQUIRE(a != c);
+    REQUIRE(a.asSymbol() == "foo");
+    
+    REQUIRE(Atom("list").isList());
+    REQUIRE(Atom("lambda").isLambda());
+    REQUIRE(Atom(1.0).asSymbolId() != Atom("list").asSymbolId());
+}
+
+void internWorker(std::vector<SymbolId> & ids){
+    
+    for(std::size_t i = 0; i < ids.size(); ++i){
+        ids[i] = SymbolTable::instance().intern("concurrent" + std::to_string(i));
+    }
+}
+
+TEST_CASE( "Test concurrent interning", "[symbol]" ) {
+    
+    std::vector<SymbolId> ids1(2000), ids2(2000);
+    
+    std::thread th1(internWorker, std::ref(ids1));
+    std::thread th2(internWorker, std::ref(ids2));
+    th1.join();
+    th2.join();
+    
+    REQUIRE(ids1 == ids2);
+    for(std::size_t i = 0; i < ids1.size(); ++i){
+        REQUIRE(SymbolTable::instance().name(ids1[i]) == "concurrent" + std::to_string(i));
+    }
+}
@@ -2,7 +2,13 @@
 
 // system includes
 #include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 
 // define constants for special characters
 const char OPENCHAR = '(';
@@ -10,11 +16,24 @@ const char CLOSECHAR = ')';
 const char COMMENTCHAR = ';';
 const char STRINGCHAR = '"';
 
-Token::Token(TokenType t): m_type(t){}
+Token::Token(TokenType t): m_type(t), m_text(nullptr), m_length(0), m_line(0), m_column(0){
+    classify();
+}
 
-Token::Token(const std::string & str): m_type(STRING), value(str) {}
+Token::Token(const std::string & str): m_type(STRING), value(str), m_text(nullptr), m_length(0),
+m_line(0), m_column(0){
+    classify();
+}
 
-Token::Token(TokenType t, const std::string & str): m_type(t), value(str) {}
+Token::Token(TokenType t, const std::string & str): m_type(t), value(str), m_text(nullptr), m_length(0),
+m_line(0), m_column(0){
+    classify();
+}
+
+Token::Token(TokenType t, const char * text, std::size_t length, std::size_t line, std::size_t column):
+m_type(t), m_text(text), m_length(length), m_line(line), m_column(column){
+    classify();
+}
 
 Token::TokenType Token::type() const{
     return m_type;
@@ -27,66 +46,372 @@ std::string Token::asString() const{
         case CLOSE:
             return ")";
         case STRING:
-            return value;
+            return std::string(data(), size());
         case STRINGBOUNDS:
             return "\"";
         case USERSTRING:
-            return value;
+            return std::string(data(), size());
     }
     return "";
 }
 
+const char * Token::data() const noexcept{
+    return (m_text != nullptr) ? m_text : value.data();
+}
+
+std::size_t Token::size() const noexcept{
+    return (m_text != nullptr) ? m_length : value.size();
+}
+
+bool Token::isNumber() const noexcept{
+    return m_isNumber;
+}
+
+double Token::asNumber() const noexcept{
+    return m_number;
+}
+
+std::size_t Token::line() const noexcept{
+    return m_line;
+}
+
+std::size_t Token::column() const noexcept{
+    return m_column;
+}
+
+// the powers of ten that are exactly representable as doubles
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-// add token to sequence unless it is empty, clears token
-void store_ifnot_empty(std::string & token, TokenSequenceType & seq){
-    if(!token.empty()){
-        seq.emplace_back(token);
-        token.clear();
+// convert the text of a number with strtod, which needs it null-terminated
+static bool convert_number(const char * begin, const char * end, double & value){
+    
+    char buffer[64];
+    std::string copy;
+    const char * text = buffer;
+    std::size_t length = end - begin;
+    if(length < sizeof(buffer)){
+        std::memcpy(buffer, begin, length);
+        buffer[length] = '\0';
+    }
+    else{
+        copy.assign(begin, end);
+        text = copy.c_str();
     }
+    
+    errno = 0;
+    value = std::strtod(text, nullptr);
+    
+    // a number too large for a double is not read as one
+    return !(errno == ERANGE && std::isinf(value));
+}
+
+// read the text between begin and end as a number if it spells one: an
+// optional sign, digits with an optional decimal point, and an optional
+// exponent. Numbers of up to 15 significant digits, and a small exponent,
+// are computed exactly by a single multiplication or division. Others are
+// left to strtod.
+static bool lex_number(const char * begin, const char * end, double & value){
+    
+    const char * c = begin;
+    bool negative = false;
+    if(c != end && (*c == '+' || *c == '-')){
+        negative = (*c == '-');
+        ++c;
+    }
+    
+    std::uint64_t mantissa = 0;
+    int digits = 0;        // significant digits in mantissa
+    int scale = 0;         // power of ten mantissa is to be multiplied by
+    bool exact = true;     // no significant digit was dropped
+    bool any = false;      // a digit was seen
+    
+    bool fraction = false;
+    for(; c != end; ++c){
+        if(*c == '.' && !fraction){
+            fraction = true;
+            continue;
+        }
+        if(!std::isdigit(static_cast<unsigned char>(*c))){
+            break;
+        }
+        
+        any = true;
+        int digit = *c - '0';
+        if(digits < 19){
+            if(mantissa != 0 || digit != 0){
+                mantissa = mantissa * 10 + digit;
+                ++digits;
+            }
+            if(fraction){
+                --scale;
+            }
+        }
+        else{
+            exact = exact && (digit == 0);
+            if(!fraction){
+                ++scale;
+            }
+        }
+    }
+    
+    if(!any){
+        return false;
+    }
+    
+    if(c != end && (*c == 'e' || *c == 'E')){
+        ++c;
+        bool negativeExponent = false;
+        if(c != end && (*c == '+' || *c == '-')){
+            negativeExponent = (*c == '-');
+            ++c;
+        }
+        if(c == end || !std::isdigit(static_cast<unsigned char>(*c))){
+            return false;
+        }
+        
+        int exponent = 0;
+        for(; c != end && std::isdigit(static_cast<unsigned char>(*c)); ++c){
+            if(exponent < 100000){
+                exponent = exponent * 10 + (*c - '0');
+            }
+        }
+        scale += negativeExponent ? -exponent : exponent;
+    }
+    
+    if(c != end){
+        return false;
+    }
+    
+    if(!exact || mantissa > (std::uint64_t(1) << 53) || scale < -22 || scale > 22){
+        return convert_number(begin, end, value);
+    }
+    
+    value = static_cast<double>(mantissa);
+    value = (scale < 0) ? value / POWERS_OF_TEN[-scale] : value * POWERS_OF_TEN[scale];
+    if(negative){
+        value = -value;
+    }
+    return true;
+}
+
+void Token::classify() noexcept{
+    
+    m_number = 0;
+    m_isNumber = (m_type == STRING) && lex_number(data(), data() + size(), m_number);
+    if(!m_isNumber){
+        m_number = 0;
+    }
+}
+
+// does c end a space-delimited token
+static bool is_delimiter(char c){
+    return std::isspace(static_cast<unsigned char>(c)) || c == OPENCHAR || c == CLOSECHAR ||
+        c == COMMENTCHAR || c == STRINGCHAR;
 }
 
 TokenSequenceType tokenize(std::istream & seq){
+    
+    std::string buffer((std::istreambuf_iterator<char>(seq)), std::istreambuf_iterator<char>());
+    
+    // the tokens must not refer to the buffer, which is local
     TokenSequenceType tokens;
-    std::string token;
+    for(const Token & token : tokenize(buffer.data(), buffer.data() + buffer.size())){
+        if(token.type() == Token::STRING || token.type() == Token::USERSTRING){
+            tokens.emplace_back(token.type(), token.asString());
+        }
+        else{
+            tokens.emplace_back(token.type());
+        }
+    }
     
-    bool stringOpen = false;
+    return tokens;
+}
+
+TokenSequenceType tokenize(const char * begin, const char * end){
+    TokenSequenceType tokens;
     
-    while(true){
-        char c = seq.get();
-        if(seq.eof()) break;
+    std::size_t line = 1;
+    const char * lineStart = begin;
+    
+    const char * c = begin;
+    while(c != end){
         
-        if(c == COMMENTCHAR){
+        std::size_t column = c - lineStart + 1;
+        
+        if(*c == '\n'){
+            ++c;
+            ++line;
+            lineStart = c;
+        }
+        else if(std::isspace(static_cast<unsigned char>(*c))){
+            ++c;
+        }
+        else if(*c == COMMENTCHAR){
             // chomp until the end of the line
-            while((!seq.eof()) && (c != '\n')){
-                c = seq.get();
+            while(c != end && *c != '\n'){
+                ++c;
             }
-            if(seq.eof()) break;
         }
-        else if(c == OPENCHAR){
-            store_ifnot_empty(token, tokens);
-            tokens.push_back(Token::TokenType::OPEN);
+        else if(*c == OPENCHAR){
+            tokens.emplace_back(Token::OPEN, c, 1, line, column);
+            ++c;
         }
-        else if(c == CLOSECHAR){
-            store_ifnot_empty(token, tokens);
-            tokens.push_back(Token::TokenType::CLOSE);
+        else if(*c == CLOSECHAR){
+            tokens.emplace_back(Token::CLOSE, c, 1, line, column);
+            ++c;
         }
-        else if(c == STRINGCHAR){
-            stringOpen = !stringOpen;
-            token.push_back(c);
-            if (!stringOpen){
-                tokens.push_back(Token(Token::USERSTRING, token));
-                token.clear();
+        else if(*c == STRINGCHAR){
+            const char * start = c;
+            std::size_t startLine = line;
+            for(++c; c != end && *c != STRINGCHAR; ++c){
+                if(*c == '\n'){
+                    ++line;
+                    lineStart = c + 1;
+                }
+            }
+            
+            // an unterminated string runs to the end as a plain token
+            if(c != end){
+                ++c;
+                tokens.emplace_back(Token::USERSTRING, start, c - start, startLine, column);
+            }
+            else{
+                tokens.emplace_back(Token::STRING, start, c - start, startLine, column);
             }
-            // tokens.push_back(Token::TokenType::STRINGBOUNDS);
-        }
-        else if(isspace(c) && !stringOpen){
-            store_ifnot_empty(token, tokens);
         }
         else{
-            token.push_back(c);
+            const char * start = c;
+            while(c != end && !is_delimiter(*c)){
+                ++c;
+            }
+            tokens.emplace_back(Token::STRING, start, c - start, line, column);
         }
     }
-    store_ifnot_empty(token, tokens);
     
     return tokens;
 }
+
+FormReader::FormReader(std::istream & stream): in(&stream), buffer(), data(nullptr), size(0), position(0){}
+
+FormReader::FormReader(const char * begin, const char * end): in(nullptr), buffer(), data(begin),
+size(end - begin), position(0){}
+
+bool FormReader::more(std::size_t & start){
+    
+    const std::size_t BLOCK_SIZE = 64 * 1024;
+    
+    if(in == nullptr){
+        return false;
+    }
+    
+    // a form spanning blocks is moved to the front once, then appended to
+    if(start > 0){
+        buffer.erase(0, start);
+        position -= start;
+        start = 0;
+    }
+    
+    std::size_t kept = buffer.size();
+    buffer.resize(kept + BLOCK_SIZE);
+    in->read(&buffer[kept], BLOCK_SIZE);
+    buffer.resize(kept + static_cast<std::size_t>(in->gcount()));
+    
+    data = buffer.data();
+    size = buffer.size();
+    
+    return size > kept;
+}
+
+bool FormReader::next(const char *& first, const char *& last){
+    
+    // skip the whitespace and comments before the form
+    bool commentOpen = false;
+    while(true){
+        if(position == size){
+            std::size_t start = position;
+            if(!more(start)){
+                return false;
+            }
+            continue;
+        }
+        
+        char c = data[position];
+        if(commentOpen){
+            commentOpen = (c != '\n');
+        }
+        else if(c == COMMENTCHAR){
+            commentOpen = true;
+        }
+        else if(!std::isspace(static_cast<unsigned char>(c))){
+            break;
+        }
+        ++position;
+    }
+    
+    std::size_t start = position;
+    std::size_t depth = 0;
+    bool stringOpen = false;
+    bool token = false;
+    bool complete = false;
+    
+    while(!complete){
+        if(position == size){
+            if(!more(start)){
+                break;
+            }
+            continue;
+        }
+        
+        char c = data[position];
+        if(commentOpen){
+            commentOpen = (c != '\n');
+        }
+        else if(stringOpen){
+            stringOpen = (c != STRINGCHAR);
+            complete = !stringOpen && (depth == 0);
+        }
+        else if(token && is_delimiter(c)){
+            // the end of a single token, which c is not part of
+            break;
+        }
+        else if(c == COMMENTCHAR){
+            commentOpen = true;
+        }
+        else if(c == STRINGCHAR){
+            stringOpen = true;
+        }
+        else if(c == OPENCHAR){
+            ++depth;
+        }
+        else if(c == CLOSECHAR){
+            complete = (depth <= 1);
+            if(depth > 0){
+                --depth;
+            }
+        }
+        else if(depth == 0){
+            token = true;
+        }
+        ++position;
+    }
+    
+    first = data + start;
+    last = data + position;
+    return true;
+}
+
+bool FormReader::next(std::string & form){
+    
+    const char * first;
+    const char * last;
+    if(!next(first, last)){
+        form.clear();
+        return false;
+    }
+    
+    form.assign(first, last);
+    return true;
+}
@@ -4,13 +4,19 @@
 #ifndef TOKEN_HPP
 #define TOKEN_HPP
 
+#include <cstddef>
 #include <deque>
 #include <istream>
+#include <string>
 
 /*! \class Token
  \brief Value class representing a token.
  
  A token is a composition of a tag type and an optional string value.
+ 
+ The value of a token made by tokenizing a buffer refers to the characters
+ of the buffer instead of copying them, so the buffer must outlive the
+ token. Such a token also records where in the buffer it starts.
  */
 class Token {
 public:
@@ -34,15 +40,53 @@ public:
     /// contruct a token of type UserString with value
     Token(TokenType t, const std::string & str);
     
+    /// construct a token of type t referring to the length characters at
+    /// text, found at line and column (counted from 1)
+    Token(TokenType t, const char * text, std::size_t length, std::size_t line, std::size_t column);
+    
     /// return the type of the token
     TokenType type() const;
     
     /// return the token rendered as a string
     std::string asString() const;
     
+    /// return the characters of the value, not null-terminated
+    const char * data() const noexcept;
+    
+    /// return the number of characters of the value
+    std::size_t size() const noexcept;
+    
+    /// return true if the token is a STRING spelling a number, e.g. 12,
+    /// -1.5 or 3e8, as decided when the token was constructed
+    bool isNumber() const noexcept;
+    
+    /// return the number the token spells, 0 if it is not a number
+    double asNumber() const noexcept;
+    
+    /// return the line the token starts at, 0 if not made by tokenizing
+    std::size_t line() const noexcept;
+    
+    /// return the column the token starts at, 0 if not made by tokenizing
+    std::size_t column() const noexcept;
+    
 private:
     TokenType m_type;
     std::string value;
+    
+    // the characters of the value in the tokenized buffer, nullptr if the
+    // value is held in value
+    const char * m_text;
+    std::size_t m_length;
+    
+    std::size_t m_line;
+    std::size_t m_column;
+    
+    // the number the value spells, if m_isNumber
+    bool m_isNumber;
+    double m_number;
+    
+    // decide whether the value spells a number
+    void classify() noexcept;
 };
 
 /*! \typedef TokenSequenceType
@@ -58,10 +102,77 @@ typedef std::deque<Token> TokenSequenceType;
  \return The sequence of tokens
  
  Split a stream into a sequnce of tokens where a token is one of
- OPEN or CLOSE or any space-delimited string
+ OPEN or CLOSE or any space-delimited string, or a user string from a '"'
+ to the next, including any whitespace, parentheses or semicolons.
  
  Ignores any whitespace and comments (from any ";" to end-of-line).
  */
 TokenSequenceType tokenize(std::istream & seq);
 
+/*! \fn TokenSequenceType tokenize(const char * begin, const char * end)
+ \brief Split a buffer into a sequence of tokens, without copying it
+ 
+ \param begin the first character of the buffer
+ \param end one past the last character of the buffer
+ \return The sequence of tokens, which refer to the buffer
+ 
+ Splits like tokenize(std::istream &), and the tokens record their line and
+ column. Large inputs, e.g. generated data files, tokenize much faster this
+ way than through a stream.
+ */
+TokenSequenceType tokenize(const char * begin, const char * end);
+
+/*! \class FormReader
+ \brief Reads the top-level forms of a program one at a time, from a stream
+ or from a buffer holding the whole program.
+ 
+ A stream is read in blocks, and only as far as the form returned, so a
+ program of any length can be evaluated form by form, in memory bounded by
+ its largest form. The forms of a buffer are returned in place. Forms are
+ split by the rules of tokenize: parentheses in user strings and comments
+ do not count.
+ */
+class FormReader {
+public:
+    
+    /// construct a reader of the forms in stream, which must outlive it
+    explicit FormReader(std::istream & stream);
+    
+    /// construct a reader of the forms in a buffer, which must outlive it
+    FormReader(const char * begin, const char * end);
+    
+    /*! Find the next top-level form, an expression in parentheses or a
+     single token, with any comments inside it.
+     \param first set to the first character of the form
+     \param last set to one past the last character of the form
+     \return false if there are no more forms
+     
+     The characters are valid until the next call. An unbalanced form at the
+     end of the input is returned as it is, to be rejected by the parser.
+     */
+    bool next(const char *& first, const char *& last);
+    
+    /*! Read the text of the next top-level form (see above).
+     \param form the string to store the text in
+     \return false if there are no more forms
+     */
+    bool next(std::string & form);
+    
+private:
+    // the stream read, nullptr when reading a buffer
+    std::istream * in;
+    
+    // the blocks read from the stream and not yet returned
+    std::string buffer;
+    
+    // the characters read, and the position of the next in them
+    const char * data;
+    std::size_t size;
+    std::size_t position;
+    
+    // read another block, dropping the characters before start, which is
+    // updated along with position. Returns false at the end of the input.
+    bool more(std::size_t & start);
+};
+
 #endif
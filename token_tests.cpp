@@ -1,5 +1,10 @@
 #include "catch.hpp"
 
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+
 #include "token.hpp"
 
 TEST_CASE( "Test Token creation", "[token]" ) {
@@ -73,3 +78,136 @@ TEST_CASE( "Test tokenize", "[token]" ) {
     REQUIRE(tokens.empty());
 }
 
+
+TEST_CASE( "Test tokenize buffer", "[token]" ) {
+    std::string input = "(define s \"a (b); c\")\n  ; a comment\n\t(+ 1\n 22)";
+    
+    TokenSequenceType tokens = tokenize(input.data(), input.data() + input.size());
+    
+    REQUIRE(tokens.size() == 10);
+    
+    // the tokens refer to the buffer
+    REQUIRE(tokens[1].type() == Token::STRING);
+    REQUIRE(tokens[1].data() == input.data() + 1);
+    REQUIRE(tokens[1].size() == 6);
+    REQUIRE(tokens[1].asString() == "define");
+    
+    // a user string includes parentheses and semicolons
+    REQUIRE(tokens[3].type() == Token::USERSTRING);
+    REQUIRE(tokens[3].asString() == "\"a (b); c\"");
+    REQUIRE(tokens[4].type() == Token::CLOSE);
+    
+    REQUIRE(tokens[5].type() == Token::OPEN);
+    REQUIRE(tokens[5].line() == 3);
+    REQUIRE(tokens[5].column() == 2);
+    REQUIRE(tokens[7].asString() == "1");
+    REQUIRE(tokens[7].line() == 3);
+    REQUIRE(tokens[7].column() == 5);
+    REQUIRE(tokens[8].asString() == "22");
+    REQUIRE(tokens[8].line() == 4);
+    REQUIRE(tokens[8].column() == 2);
+    REQUIRE(tokens[9].type() == Token::CLOSE);
+    
+    // the stream tokenizer splits the same way
+    std::istringstream iss(input);
+    TokenSequenceType copied = tokenize(iss);
+    REQUIRE(copied.size() == tokens.size());
+    for(std::size_t i = 0; i < tokens.size(); ++i){
+        REQUIRE(copied[i].type() == tokens[i].type());
+        REQUIRE(copied[i].asString() == tokens[i].asString());
+    }
+}
+
+TEST_CASE( "Test token numbers", "[token]" ) {
+    
+    REQUIRE(Token("12").isNumber());
+    REQUIRE(Token("12").asNumber() == 12.);
+    REQUIRE(Token("-1.5").asNumber() == -1.5);
+    REQUIRE(Token("+.5").asNumber() == 0.5);
+    REQUIRE(Token("5.").asNumber() == 5.);
+    REQUIRE(Token("3e8").asNumber() == 3e8);
+    REQUIRE(Token("2.5E-3").asNumber() == 2.5e-3);
+    REQUIRE(Token("0.000001").asNumber() == 1e-6);
+    REQUIRE(Token("123456789012345678901234").asNumber() == 123456789012345678901234.);
+    REQUIRE(Token("1e-400").asNumber() == 0.);
+    
+    for(std::string text : {"", "-", "+", ".", "e5", "1e", "1e+", "1.2.3", "1a", "--1", "1e5e5", "1e999", "pi"}){
+        INFO(text);
+        REQUIRE(!Token(text).isNumber());
+    }
+    
+    // only plain tokens are numbers
+    REQUIRE(!Token(Token::USERSTRING, "1").isNumber());
+    
+    // the exact value strtod reads, including where the fast path does not apply
+    std::mt19937 gen(3574);
+    std::uniform_real_distribution<double> mantissa(-1e4, 1e4);
+    std::uniform_int_distribution<int> exponent(-40, 40);
+    for(int i = 0; i < 10000; ++i){
+        std::ostringstream oss;
+        oss.precision(1 + i % 20);
+        oss << mantissa(gen) * std::pow(10., exponent(gen));
+        std::string text = oss.str();
+        INFO(text);
+        Token token(text);
+        REQUIRE(token.isNumber());
+        REQUIRE(token.asNumber() == std::strtod(text.c_str(), nullptr));
+    }
+}
+
+TEST_CASE( "Test reading top-level forms", "[token]" ) {
+    std::string input = R"(
+    (define a 1) ; (not a form
+    (define s "a ) ; b")
+    
+    (+ a
+       ; comment )
+       2) 3 "top"(list)
+    (unbalanced)";
+    
+    std::istringstream iss(input);
+    FormReader reader(iss);
+    std::string form;
+    
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "(define a 1)");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "(define s \"a ) ; b\")");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "(+ a\n       ; comment )\n       2)");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "3");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "\"top\"");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "(list)");
+    REQUIRE(reader.next(form));
+    REQUIRE(form == "(unbalanced");
+    REQUIRE(!reader.next(form));
+    REQUIRE(!reader.next(form));
+}
+
+TEST_CASE( "Test reading forms across blocks", "[token]" ) {
+    
+    // forms longer than a block of the reader
+    std::ostringstream program;
+    for(int i = 0; i < 3; ++i){
+        program << "(list";
+        for(int j = 0; j < 20000; ++j){
+            program << " " << j;
+        }
+        program << ")\n";
+    }
+    
+    std::istringstream iss(program.str());
+    FormReader reader(iss);
+    std::string form;
+    
+    for(int i = 0; i < 3; ++i){
+        REQUIRE(reader.next(form));
+        TokenSequenceType tokens = tokenize(form.data(), form.data() + form.size());
+        REQUIRE(tokens.size() == 20003);
+        REQUIRE(tokens[20001].asNumber() == 19999.);
+    }
+    REQUIRE(!reader.next(form));
+}
@@ -0,0 +1,283 @@
+#include "vm.hpp"
+
+// system includes
+#include <algorithm>
+#include <iterator>
+
+// module includes
+#include "parallel.hpp"
+#include "semantic_error.hpp"
+
+Expression VirtualMachine::run(const std::shared_ptr<const Chunk> & program, Environment & env){
+
+    // discard anything left behind by a run aborted by an error
+    stack.clear();
+    frames.clear();
+    if(env.get_memo() != nullptr){
+        env.get_memo()->abandon_calls(0);
+    }
+
+    frames.push_back(CallFrame{program, 0, 0, nullptr, nullptr, 0});
+
+    return execute(env);
+}
+
+Expression VirtualMachine::apply(const Atom & op, std::vector<Expression> & args, Environment & env){
+
+    stack.clear();
+    frames.clear();
+
+    stack.assign(std::make_move_iterator(args.begin()), std::make_move_iterator(args.end()));
+    call(op, stack.size(), env, false);
+
+    // a built-in has left its result, a lambda has pushed the frame of its body
+    if(frames.empty()){
+        Expression result = std::move(stack.back());
+        stack.clear();
+        return result;
+    }
+
+    return execute(env);
+}
+
+Expression VirtualMachine::execute(Environment & env){
+
+    while(true){
+
+        CallFrame & frame = frames.back();
+        const Chunk & chunk = *frame.chunk;
+        const Instruction & ins = chunk.code[frame.ip++];
+
+        switch(ins.op){
+            case Instruction::PUSH_CONST:
+                stack.push_back(chunk.constants[ins.a]);
+                break;
+
+            case Instruction::LOAD:
+            {
+                const Atom & sym = chunk.symbols[ins.a];
+                if(!env.is_exp(sym)){
+                    throw SemanticError("Error during evaluation: unknown symbol");
+                }
+                stack.push_back(env.get_exp(sym));
+            }
+                break;
+
+            case Instruction::LOAD_SLOT:
+                if(ins.a == 0){
+                    stack.push_back(stack[frame.base + ins.b]);
+                }
+                else{
+                    const Frame * f = frame.closure.get();
+                    for(std::uint32_t depth = 1; depth < ins.a; ++depth){
+                        f = f->parent.get();
+                    }
+                    stack.push_back(f->slots[ins.b]);
+                }
+                break;
+
+            case Instruction::POP:
+                stack.pop_back();
+                break;
+
+            case Instruction::DEFINE:
+                env.add_exp(chunk.symbols[ins.a], stack.back());
+                break;
+
+            case Instruction::DEFINE_PROC:
+                env.add_proc(chunk.symbols[ins.a], stack.back(), chunk.functions[ins.b], capture(frame));
+                break;
+
+            case Instruction::MAKE_LIST:
+            {
+                Expression list(Atom("list"));
+                std::size_t base = stack.size() - ins.a;
+                for(std::size_t i = base; i < stack.size(); ++i){
+                    list.append(std::move(stack[i]));
+                }
+                stack.resize(base);
+                stack.push_back(std::move(list));
+            }
+                break;
+
+            case Instruction::CHECK_PROC:
+                if(!env.is_proc(chunk.symbols[ins.a])){
+                    throw SemanticError(chunk.messages[ins.b]);
+                }
+                break;
+
+            case Instruction::CALL:
+                // may push a frame, invalidating the frame reference
+                call(chunk.symbols[ins.a], ins.b, env, false, &chunk.calls[ins.a]);
+                break;
+
+            case Instruction::TAIL_CALL:
+                // may replace the frame; a built-in leaves its result for the RETURN that follows
+                call(chunk.symbols[ins.a], ins.b, env, true, &chunk.calls[ins.a]);
+                break;
+
+            case Instruction::ITER_BEGIN:
+                // the iteration state is [list, index, result] on the stack
+                stack.push_back(Expression(0.0));
+                stack.push_back(Expression(Atom("list")));
+                break;
+
+            case Instruction::ITER_NEXT:
+            {
+                std::size_t n = stack.size();
+                const Expression & list = stack[n-3];
+                int index = stack[n-2].head().asNumber();
+
+                if(index < list.tailSize()){
+                    Expression next = list.tailAt(index);
+                    stack[n-2] = Expression(index + 1.0);
+                    stack.push_back(std::move(next));
+                }
+                else{
+                    Expression result = std::move(stack[n-1]);
+                    stack.resize(n-3);
+                    stack.push_back(std::move(result));
+                    frame.ip = ins.a;
+                }
+            }
+                break;
+
+            case Instruction::ITER_COLLECT:
+            {
+                Expression value = std::move(stack.back());
+                stack.pop_back();
+                stack.back().append(std::move(value));
+            }
+                break;
+
+            case Instruction::PARALLEL_MAP:
+                stack.back() = parallel_map(chunk.symbols[ins.a], stack.back(), env);
+                break;
+
+            case Instruction::JUMP:
+                frame.ip = ins.a;
+                break;
+
+            case Instruction::JUMP_IF_FALSE:
+            {
+                if(!stack.back().isHeadNumber()){
+                    throw SemanticError("Error during evaluation: condition of if not a number");
+                }
+                bool condition = stack.back().head().asNumber() != 0;
+                stack.pop_back();
+                if(!condition){
+                    frame.ip = ins.a;
+                }
+            }
+                break;
+
+            case Instruction::THROW:
+                throw SemanticError(chunk.messages[ins.a]);
+
+            case Instruction::RETURN:
+            {
+                // replace the arguments with the result
+                Expression result = std::move(stack.back());
+                if(env.get_memo() != nullptr){
+                    env.get_memo()->finish_calls(frame.calls, result);
+                }
+                stack.resize(frame.base);
+                frames.pop_back();
+                
+                if(frames.empty()){
+                    return result;
+                }
+                stack.push_back(std::move(result));
+            }
+                break;
+        }
+    }
+}
+
+void VirtualMachine::call(const Atom & op, std::size_t nargs, Environment & env, bool tail, CallCache * cache){
+
+    // a built-in resolved through the inline cache needs none of the lookups below
+    Procedure builtin = (cache != nullptr) ? env.get_builtin(op, *cache) : nullptr;
+
+    // head must be a symbol that maps to a proc
+    if(builtin == nullptr && !env.is_proc(op)){
+        throw SemanticError("Error during evaluation: symbol does not name a procedure");
+    }
+
+    std::size_t base = stack.size() - nargs;
+
+    if(builtin == nullptr && env.is_lambda(op)){
+        std::shared_ptr<const Chunk> body = env.get_code(op);
+        std::shared_ptr<const Frame> closure = env.get_closure(op);
+
+        // lambdas defined by the tree walker are compiled on first call
+        if(!body){
+            Expression lambda = env.get_exp(op);
+            body = compile_lambda(lambda, closure.get(), &env);
+            env.add_proc(op, lambda, body, closure);
+        }
+
+        if(body->parameters.size() != nargs){
+            throw SemanticError("Error: during apply: Error in call to procedure: invalid number of arguments.");
+        }
+
+        // the result of a call to a Pure lambda may be cached
+        MemoCache * memo = env.get_memo();
+        std::size_t calls = (memo != nullptr) ? memo->pending() : 0;
+        if(memo != nullptr && env.get_purity(op) == Environment::Pure){
+            MemoCache::Key key(op.asSymbolId(), std::vector<Expression>(stack.begin() + base, stack.end()));
+            Expression result;
+            if(memo->find(key, result)){
+                // left on the stack as by a built-in
+                stack.resize(base);
+                stack.push_back(std::move(result));
+                return;
+            }
+            memo->begin_call(std::move(key));
+        }
+
+        if(tail){
+            // the arguments replace those of the current frame, which is reused
+            CallFrame & frame = frames.back();
+            std::move(stack.begin() + base, stack.end(), stack.begin() + frame.base);
+            stack.resize(frame.base + nargs);
+            frame = CallFrame{body, 0, frame.base, closure, nullptr, frame.calls};
+            return;
+        }
+
+        if(frames.size() >= MAX_CALL_DEPTH){
+            throw SemanticError("Error during evaluation: maximum call depth exceeded");
+        }
+
+        // the arguments on the stack become the slots of the new frame
+        frames.push_back(CallFrame{body, 0, base, closure, nullptr, calls});
+    }
+    else{
+        Procedure proc = (builtin != nullptr) ? builtin : env.get_proc(op);
+
+        arguments.assign(std::make_move_iterator(stack.begin() + base), std::make_move_iterator(stack.end()));
+        stack.resize(base);
+
+        stack.push_back(proc(arguments));
+    }
+}
+
+std::shared_ptr<const Frame> VirtualMachine::capture(CallFrame & frame){
+
+    const std::vector<Atom> & parameters = frame.chunk->parameters;
+
+    // without parameters the activation has no frame of its own
+    if(parameters.empty()){
+        return frame.closure;
+    }
+
+    if(!frame.captured){
+        std::shared_ptr<Frame> f = std::make_shared<Frame>();
+        f->slots.assign(stack.begin() + frame.base, stack.begin() + frame.base + parameters.size());
+        f->names = std::shared_ptr<const std::vector<Atom>>(frame.chunk, &parameters);
+        f->parent = frame.closure;
+        frame.captured = f;
+    }
+
+    return frame.captured;
+}
@@ -0,0 +1,92 @@
+/*! \file vm.hpp
+ Defines the stack-based virtual machine that executes compiled bytecode.
+ */
+#ifndef VM_HPP
+#define VM_HPP
+
+// system includes
+#include <memory>
+#include <vector>
+
+// module includes
+#include "compiler.hpp"
+#include "environment.hpp"
+#include "expression.hpp"
+
+/*! \class VirtualMachine
+ \brief Executes a compiled Chunk against an Environment.
+
+ The machine keeps an explicit value stack and call-frame stack, so calling a
+ lambda pushes a frame instead of recursing in C++. The stacks are kept
+ between runs to avoid reallocating them for every evaluation.
+ 
+ A call in tail position reuses the frame of the caller, so tail recursion
+ runs in constant space and is not limited by the call depth.
+
+ The arguments of a lambda call stay on the value stack where the caller left
+ them and are read by slot index, so binding them costs nothing. Only when the
+ body defines a lambda that captures them are they copied into a heap Frame.
+ */
+class VirtualMachine {
+public:
+
+    /*! Run a compiled program to completion.
+     \param program the chunk to execute
+     \param env the environment to evaluate in
+     \return the Expression the program evaluates to
+     \throws SemanticError when a semantic error is encountered
+     */
+    Expression run(const std::shared_ptr<const Chunk> & program, Environment & env);
+
+    /*! Call a procedure with the given arguments, as a CALL instruction would.
+     \param op the symbol naming the procedure
+     \param args the arguments, which are moved from
+     \param env the environment to evaluate in
+     \return the Expression the call evaluates to
+     \throws SemanticError when a semantic error is encountered
+     */
+    Expression apply(const Atom & op, std::vector<Expression> & args, Environment & env);
+
+private:
+
+    // an activation of a chunk: the code being run and where in it
+    struct CallFrame {
+        std::shared_ptr<const Chunk> chunk;
+        std::size_t ip;
+        
+        // stack index of the first argument
+        std::size_t base;
+        
+        // the frame the lambda was defined in
+        std::shared_ptr<const Frame> closure;
+        
+        // the arguments copied to the heap, once a nested lambda captures them
+        std::shared_ptr<const Frame> captured;
+        
+        // number of memoized calls pending when the frame was pushed. Those
+        // begun since finish with the RETURN of the frame (see MemoCache).
+        std::size_t calls;
+    };
+
+    // the value stack
+    std::vector<Expression> stack;
+
+    // the call-frame stack
+    std::vector<CallFrame> frames;
+
+    // scratch vector for the arguments of built-in procedures
+    std::vector<Expression> arguments;
+
+    // execute instructions from the top frame until the bottom frame returns
+    Expression execute(Environment & env);
+
+    // call the procedure op with the top nargs values of the stack, reusing
+    // the current frame if the call is in tail position. cache is the inline
+    // cache of the call site, if it has one.
+    void call(const Atom & op, std::size_t nargs, Environment & env, bool tail, CallCache * cache = nullptr);
+    
+    // return the frame for lambdas defined by the current activation to capture
+    std::shared_ptr<const Frame> capture(CallFrame & frame);
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "catch.hpp"
+
+#include <sstream>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+Expression runInMode(const std::string & program, Interpreter::EvaluationMode mode){
+
+    std::istringstream iss(program);
+
+    Interpreter interp;
+    interp.setEvaluationMode(mode);
+
+    REQUIRE(interp.parseStream(iss));
+
+    return interp.evaluate();
+}
+
+TEST_CASE( "Test bytecode and tree walker agree", "[vm]" ) {
+
+    std::vector<std::string> programs = {"(+ 1 2 3)",
+        "(- (* 2 I) 1)",
+        "(begin (define a 1) (define b pi) (+ a b))",
+        "(begin (define f (lambda (x y) (* x y))) (f 3 4))",
+        "(begin (define a 1) (define x 100) (define f (lambda (x) (begin (define b 12) (+ a b x)))) (f 2))",
+        "(apply + (list 1 2 3 4))",
+        "(begin (define complexAsList (lambda (x) (list (real x) (imag x)))) (apply complexAsList (list (+ 1 (* 3 I)))))",
+        "(map / (list 1 2 4))",
+        "(begin (define f (lambda (x) (sin x))) (map f (list (- pi) (/ (- pi) 2) 0 (/ pi 2) pi)))",
+        "(begin (define sq (lambda (x) (* x x))) (map sq (range 0 10 1)))",
+        "(begin (define sq (lambda (x) (* x x))) (pmap sq (range 0 100 1)))",
+        "(begin (define n 3) (define f (lambda (x) (+ x n))) (pmap f (list 1 2 (+ n 1))))",
+        "(begin (define x 100) (define f (lambda (x) x)) (f 2) x)",
+        "(begin (define id (lambda (x) x)) (define f (lambda (x) (+ (id 1) x))) (f 10))",
+        "(begin (define f (lambda (x) (begin (define g (lambda (y) (+ x y))) x))) (f 10) (f 20) (g 1))",
+        "(begin (define max (lambda (a b) (if (< a b) b a))) (list (max 1 2) (max 4 3)))",
+        "(begin (define count (lambda (n acc) (if (< n 1) acc (count (- n 1) (+ acc 1))))) (count 10 0))",
+        "(list 1 (list 2 3) \"text\")",
+        "(* 2 (+ (list 1 2) (range 0 1 1)))",
+        "(first (rest (list 1 2 3)))",
+        "(get-property \"key\" (set-property \"key\" 3 (list)))"};
+
+    for(auto program : programs){
+        INFO(program);
+        REQUIRE(runInMode(program, Interpreter::BytecodeMode) == runInMode(program, Interpreter::TreeWalkMode));
+    }
+}
+
+TEST_CASE( "Test pmap and map leave the same definitions", "[vm]" ) {
+
+    // the procedures define globally, directly or through another lambda
+    std::string defines = "(define f (lambda (x) (begin (define y x) (define total (+ total x)) y)))"
+        "(define g (lambda (x) (f (* 2 x))))";
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        for(std::string proc : {"f", "g"}){
+            std::string result = "(list y total)";
+            std::string mapped = "(begin (define total 0) " + defines + " (map " + proc + " (range 1 100 1)) " + result + ")";
+            std::string pmapped = "(begin (define total 0) " + defines + " (pmap " + proc + " (range 1 100 1)) " + result + ")";
+            INFO(pmapped);
+            REQUIRE(runInMode(pmapped, mode) == runInMode(mapped, mode));
+        }
+    }
+}
+
+TEST_CASE( "Test lambdas without parameters close over enclosing parameters", "[vm]" ) {
+
+    std::vector<std::pair<std::string, Expression>> programs = {
+        {"(begin (define mk (lambda (x) (begin (define g (lambda (1) x)) (apply g (list))))) (mk 5))", Expression(5.)},
+        {"(begin (define mk (lambda (x y) (begin (define g (lambda (1) (+ x y))) (apply g (list))))) (mk 5 6))", Expression(11.)},
+        {"(begin (define mk (lambda (x) (begin (define g (lambda (1) (begin (define h (lambda (y) (+ x y))) (h 2)))) (apply g (list))))) (mk 5))", Expression(7.)}};
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        for(const auto & program : programs){
+            INFO(program.first);
+            REQUIRE(runInMode(program.first, mode) == program.second);
+        }
+    }
+}
+
+TEST_CASE( "Test literal lists of numbers stay packed", "[vm]" ) {
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        std::istringstream iss("(list 1 2 3)");
+
+        Interpreter interp;
+        interp.setEvaluationMode(mode);
+        REQUIRE(interp.parseStream(iss));
+
+        // each evaluation shares the numbers of the program, unexpanded
+        Expression first = interp.evaluate();
+        Expression second = interp.evaluate();
+        REQUIRE(first.tailNumbers() != nullptr);
+        REQUIRE(first.tailNumbers() == second.tailNumbers());
+        REQUIRE(first == Expression(std::vector<double>{1., 2., 3.}));
+    }
+}
+
+TEST_CASE( "Test bytecode semantic errors", "[vm]" ) {
+
+    std::vector<std::string> programs = {"(+ 1 a)",
+        "(begin)",
+        "(define a 1 2)",
+        "(1 2 3)",
+        "(notaproc 1)",
+        "(apply / (list 1 2 4))",
+        "(map 3 (list 1 2 3))",
+        "(pmap 3 (list 1 2 3))",
+        "(pmap + 3)",
+        "(begin (define f (lambda (x) (first x))) (pmap f (list (list 1) 2)))",
+        "(if 1 2)",
+        "(if (list) 1 2)",
+        "(begin (define addtwo (lambda (x y) (+ x y))) (map addtwo (list 1 2 3)))"};
+
+    for(auto program : programs){
+        INFO(program);
+        REQUIRE_THROWS_AS(runInMode(program, Interpreter::BytecodeMode), const SemanticError &);
+    }
+}
+
+TEST_CASE( "Test bytecode runs lambdas defined by the tree walker", "[vm]" ) {
+
+    Interpreter interp;
+
+    {
+        std::istringstream iss("(define f (lambda (x) (+ x 1)))");
+        interp.setEvaluationMode(Interpreter::TreeWalkMode);
+        REQUIRE(interp.parseStream(iss));
+        REQUIRE_NOTHROW(interp.evaluate());
+    }
+
+    {
+        std::istringstream iss("(map f (list 1 2))");
+        interp.setEvaluationMode(Interpreter::BytecodeMode);
+        REQUIRE(interp.parseStream(iss));
+
+        Expression expected(Atom("list"));
+        expected.append(Atom(2.));
+        expected.append(Atom(3.));
+        REQUIRE(interp.evaluate() == expected);
+    }
+}
+
+TEST_CASE( "Test bytecode runs closures defined by the tree walker", "[vm]" ) {
+
+    Interpreter interp;
+
+    {
+        std::istringstream iss("(define f (lambda (x) (begin (define g (lambda (y) (+ x y))) x)))");
+        interp.setEvaluationMode(Interpreter::TreeWalkMode);
+        REQUIRE(interp.parseStream(iss));
+        REQUIRE_NOTHROW(interp.evaluate());
+    }
+
+    {
+        std::istringstream iss("(begin (f 10) (define x 100) (g 1))");
+        interp.setEvaluationMode(Interpreter::BytecodeMode);
+        REQUIRE(interp.parseStream(iss));
+        REQUIRE(interp.evaluate() == Expression(11.));
+    }
+}
+
+TEST_CASE( "Test tail calls run in constant space", "[vm]" ) {
+
+    {
+        INFO("past the call depth limit of the virtual machine");
+        std::string program = "(begin (define count (lambda (n acc) (if (< n 1) acc (count (- n 1) (+ acc 1))))) (count 200000 0))";
+        REQUIRE(runInMode(program, Interpreter::BytecodeMode) == Expression(200000.));
+    }
+
+    {
+        INFO("deeper than the C++ stack allows the tree walker to recurse");
+        std::string program = "(begin (define count (lambda (n acc) (if (< n 1) acc (count (- n 1) (+ acc 1))))) (count 50000 0))";
+        REQUIRE(runInMode(program, Interpreter::TreeWalkMode) == Expression(50000.));
+    }
+}
+
+TEST_CASE( "Test bytecode limits call depth", "[vm]" ) {
+
+    // the recursive call is not in tail position, so each one needs a frame
+    std::string program = "(begin (define f (lambda (x) (+ (f x) 1))) (f 1))";
+
+    REQUIRE_THROWS_AS(runInMode(program, Interpreter::BytecodeMode), const SemanticError &);
+}
+
+TEST_CASE( "Test tree walker limits call depth", "[vm]" ) {
+
+    std::string recurse = "(define f (lambda (n) (if (< n 1) 0 (+ 1 (f (- n 1))))))";
+
+    for(auto mode : {Interpreter::BytecodeMode, Interpreter::TreeWalkMode}){
+        {
+            INFO("within the limit");
+            REQUIRE(runInMode("(begin " + recurse + " (f 50000))", mode) == Expression(50000.));
+        }
+
+        {
+            INFO("past the limit, reported rather than overflowing the stack");
+            REQUIRE_THROWS_WITH(runInMode("(begin " + recurse + " (f 200000))", mode),
+                                "Error during evaluation: maximum call depth exceeded");
+        }
+    }
+}